@@ -0,0 +1,72 @@
+/*
+ *	MPTCP implementation - Generic netlink path-manager interface
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _LINUX_MPTCP_GENL_H
+#define _LINUX_MPTCP_GENL_H
+
+#include <linux/types.h>
+
+#define MPTCP_GENL_NAME		"mptcp"
+#define MPTCP_GENL_VERSION	1
+#define MPTCP_GENL_EV_GRP_NAME	"mptcp_events"
+
+/* Commands (user->kernel) and events (kernel->user, on the multicast-group
+ * MPTCP_GENL_EV_GRP_NAME). Events are sent in the netns of the connection.
+ */
+enum {
+	MPTCP_CMD_UNSPEC,
+	MPTCP_CMD_EXEC,		/* Execute the MPTCP_ATTR_OPs on the
+				 * connection MPTCP_ATTR_TOKEN, in order.
+				 * Stops at the first failing one.
+				 */
+
+	MPTCP_EVENT_CREATED,	/* The connection is using MPTCP */
+	MPTCP_EVENT_CLOSED,
+	MPTCP_EVENT_ANNOUNCED,	/* The peer announced an address */
+	MPTCP_EVENT_REMOVED,	/* The peer withdrew the address-id */
+	MPTCP_EVENT_SUB_ESTABLISHED,
+	MPTCP_EVENT_SUB_CLOSED,
+
+	__MPTCP_CMD_MAX,
+};
+#define MPTCP_CMD_MAX	(__MPTCP_CMD_MAX - 1)
+
+/* Operations of an MPTCP_CMD_EXEC batch */
+enum {
+	MPTCP_OP_UNSPEC,
+	MPTCP_OP_ANNOUNCE,	/* FAMILY, LOC_ADDR, [BACKUP] */
+	MPTCP_OP_WITHDRAW,	/* FAMILY, LOC_ADDR */
+	MPTCP_OP_SUB_CREATE,	/* FAMILY, LOC_ID, REM_ID */
+	MPTCP_OP_SUB_DESTROY,	/* PATH_INDEX */
+	MPTCP_OP_SUB_PRIORITY,	/* PATH_INDEX, BACKUP */
+
+	__MPTCP_OP_MAX,
+};
+#define MPTCP_OP_MAX	(__MPTCP_OP_MAX - 1)
+
+enum {
+	MPTCP_ATTR_UNSPEC,
+	MPTCP_ATTR_TOKEN,	/* u32, local token of the connection */
+	MPTCP_ATTR_OP,		/* nested, one per operation */
+	MPTCP_ATTR_OP_TYPE,	/* u8, MPTCP_OP_* */
+	MPTCP_ATTR_FAMILY,	/* u16, AF_INET or AF_INET6 */
+	MPTCP_ATTR_LOC_ADDR,	/* struct in_addr or struct in6_addr */
+	MPTCP_ATTR_REM_ADDR,	/* struct in_addr or struct in6_addr */
+	MPTCP_ATTR_LOC_PORT,	/* u16, network byte-order */
+	MPTCP_ATTR_REM_PORT,	/* u16, network byte-order */
+	MPTCP_ATTR_LOC_ID,	/* u8 */
+	MPTCP_ATTR_REM_ID,	/* u8 */
+	MPTCP_ATTR_PATH_INDEX,	/* u8 */
+	MPTCP_ATTR_BACKUP,	/* u8 */
+
+	__MPTCP_ATTR_MAX,
+};
+#define MPTCP_ATTR_MAX	(__MPTCP_ATTR_MAX - 1)
+
+#endif /* _LINUX_MPTCP_GENL_H */
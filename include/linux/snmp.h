@@ -231,6 +231,15 @@ enum
 	LINUX_MIB_TCPDEFERACCEPTDROP,
 	LINUX_MIB_IPRPFILTER, /* IP Reverse Path Filter (rp_filter) */
 	LINUX_MIB_TCPTIMEWAITOVERFLOW,		/* TCPTimeWaitOverflow */
+	LINUX_MIB_MPTCPOFOQUEUE,		/* MPTCPOFOQueue */
+	LINUX_MIB_MPTCPOFOQUEUESTEPS,		/* MPTCPOFOQueueSteps */
+	LINUX_MIB_MPTCPOFOMERGE,		/* MPTCPOFOMerge */
+	LINUX_MIB_MPTCPWINUPDATE,		/* MPTCPWinUpdate */
+	LINUX_MIB_MPTCPWINUPDATESAVED,		/* MPTCPWinUpdateSaved */
+	LINUX_MIB_MPTCPRCVBUFGROW,		/* MPTCPRcvBufGrow */
+	LINUX_MIB_MPTCPRCVBUFSHRINK,		/* MPTCPRcvBufShrink */
+	LINUX_MIB_MPTCPRCVWNDLIMITED,		/* MPTCPRcvWndLimited */
+	LINUX_MIB_MPTCPFASTPATHRCV,		/* MPTCPFastPathRcv */
 	__LINUX_MIB_MAX
 };
 
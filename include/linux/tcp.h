@@ -110,6 +110,8 @@ enum {
 #define TCP_USER_TIMEOUT	18	/* How long for loss retry before timeout */
 #define TCP_MULTIPATH_CONNID 50	/* Get unique conn. identifier, cf. RFC6897 */
 #define TCP_MULTIPATH_SUBFLOWS	51	/* Get subflow list, cf. RFC6897 */
+#define TCP_MULTIPATH_SCHEDULER	52	/* MPTCP packet scheduler */
+#define TCP_MULTIPATH_INFO	53	/* Get meta- and subflow-state */
 
 /* for TCP_INFO socket option */
 #define TCPI_OPT_TIMESTAMPS	1
@@ -224,6 +226,47 @@ struct mptcp_subflow {
 	};
 };
 
+/* TCP_MULTIPATH_INFO data: a struct mptcp_meta_info, followed by one
+ * struct mptcp_sub_info per subflow (as many as fit in the buffer).
+ * INET_DIAG_MPTCPINFO carries a struct mptcp_diag_info per subflow.
+ */
+struct mptcp_meta_info {
+	__u32	mptcpi_loc_token;
+	__u32	mptcpi_rem_token;
+	__u8	mptcpi_subflows;	/* Number of subflows */
+	__u8	mptcpi_established;	/* ... of which are established */
+	__u8	mptcpi_dss_csum;
+	__u8	mptcpi_infinite;	/* Fallen back to infinite mapping */
+
+	__u32	mptcpi_ofo_queue;	/* Segments in meta out-of-order queue */
+	__u32	mptcpi_reinject_queue;	/* Segments waiting for reinjection */
+	__u32	mptcpi_snd_wnd;
+	__u32	mptcpi_rcv_wnd;
+	__u32	mptcpi_unacked;		/* Bytes not yet DATA_ACKed */
+};
+
+struct mptcp_sub_info {
+	__u8	mptcpi_path_index;
+	__u8	mptcpi_state;
+	__u8	mptcpi_low_prio;	/* We use this subflow as backup */
+	__u8	mptcpi_rcv_low_prio;	/* The peer uses it as backup */
+
+	__u32	mptcpi_rtt;		/* usec */
+	__u32	mptcpi_rttvar;		/* usec */
+	__u32	mptcpi_snd_cwnd;
+	__u32	mptcpi_snd_ssthresh;
+	__u32	mptcpi_unacked;
+	__u32	mptcpi_retrans;
+
+	__u64	mptcpi_bytes_sched;	/* Meta-data scheduled on this subflow */
+	__u64	mptcpi_bytes_reinj;	/* ... of which were reinjections */
+};
+
+struct mptcp_diag_info {
+	struct mptcp_meta_info	meta;
+	struct mptcp_sub_info	sub;
+};
+
 #ifdef __KERNEL__
 
 #include <linux/skbuff.h>
@@ -295,7 +338,7 @@ struct tcp_out_options {
 	struct mptcp_loc4 *addr4;/* v4 addresses for MPTCP */
 	struct mptcp_loc6 *addr6;/* v6 addresses for MPTCP */
 
-	u16	remove_addrs;	/* list of address id */
+	u64	remove_addrs;	/* list of address id */
 	u8	addr_id;	/* address id */
 #endif /* CONFIG_MPTCP */
 };
@@ -324,6 +367,8 @@ struct tcp_options_received {
 struct mptcp_cb;
 struct mptcp_tcp_sock;
 
+#define MPTCP_SCHED_NAME_MAX	16
+
 static inline void tcp_clear_options(struct tcp_options_received *rx_opt)
 {
 	rx_opt->tstamp_ok = rx_opt->sack_ok = 0;
@@ -554,6 +599,8 @@ struct tcp_sock {
 	struct hlist_nulls_node tk_table;
 	u32		mptcp_loc_token;
 	u64		mptcp_loc_key;
+	/* Packet scheduler selected through TCP_MULTIPATH_SCHEDULER */
+	char		mptcp_sched_name[MPTCP_SCHED_NAME_MAX];
 #endif /* CONFIG_MPTCP */
 };
 
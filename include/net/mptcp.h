@@ -83,6 +83,7 @@ struct mptcp_request_sock {
 	__u8				rem_id; /* Address-id in the MP_JOIN */
 	u8				dss_csum:1,
 					low_prio:1;
+	u16				collide_hash; /* Bucket of collide_tuple */
 };
 
 static inline
@@ -131,17 +132,30 @@ struct mptcp_options_received {
 	u32	data_seq;
 	u16	data_len;
 
-	u32	mptcp_rem_token;/* Remote token */
-	u64	mptcp_rem_key;	/* Remote key */
-
-	u32	mptcp_recv_nonce;
-	u64	mptcp_recv_tmac;
-	u8	mptcp_recv_mac[20];
+	/* Handshake-only fields. A segment carries at most one MP_CAPABLE or
+	 * MP_JOIN option, thus they share their space.
+	 */
+	union {
+		struct {			/* MP_CAPABLE */
+			u64	mptcp_rem_key;	/* Remote key */
+			u64	mptcp_echo_key;	/* Our key, echoed in the third ACK */
+		};
+		struct {			/* MP_JOIN SYN and SYN/ACK */
+			u32	mptcp_rem_token;/* Remote token */
+			u32	mptcp_recv_nonce;
+			u64	mptcp_recv_tmac;
+		};
+		u8	mptcp_recv_mac[20];	/* MP_JOIN third ACK */
+	};
 };
 
+/* Size of the per-subflow private area of the packet scheduler, in u32s */
+#define MPTCP_SCHED_PRIV_SIZE	4
+
 struct mptcp_tcp_sock {
+	/* The first cache-line holds what is needed for every segment */
 	struct tcp_sock	*next;		/* Next subflow socket */
-	struct mptcp_options_received rx_opt;
+	struct tcp_sock *tp; /* Where is my daddy? */
 
 	 /* Those three fields record the current mapping */
 	u64	map_data_seq;
@@ -166,35 +180,61 @@ struct mptcp_tcp_sock {
 	u32	snt_isn;
 	u32	rcv_isn;
 	u32	last_data_seq;
+	u32	last_end_data_seq;
 	u8	path_index;
-	u8	add_addr4; /* bit-field of addrs not yet sent to our peer */
-	u8	add_addr6;
 	u8	rem_id;
 
-	u32	last_rbuf_opti;	/* Timestamp of last rbuf optimization */
+	int	init_rcv_wnd;
 	unsigned int sent_pkts;
+	u32	last_rbuf_opti;	/* Timestamp of last rbuf optimization */
 
-	struct sk_buff  *shortcut_ofoqueue; /* Shortcut to the current modified
-					     * skb in the ofo-queue.
-					     */
+	/* Private data of the packet scheduler */
+	u32	mptcp_sched[MPTCP_SCHED_PRIV_SIZE];
 
-	int	init_rcv_wnd;
+	/* Meta-level bytes scheduled on this subflow (see TCP_MULTIPATH_INFO),
+	 * and how many of them were reinjections or retransmissions.
+	 */
+	u64	bytes_sched;
+	u64	bytes_reinj;
+
+	u32	add_addr4; /* bit-field of addrs not yet sent to our peer */
+	u32	add_addr6;
 	u32	infinite_cutoff_seq;
-	struct delayed_work work;
 	u32	mptcp_loc_nonce;
-	struct tcp_sock *tp; /* Where is my daddy? */
-	u32	last_end_data_seq;
 
-	/* MP_JOIN subflow: timer for retransmitting the 3rd ack */
-	struct timer_list mptcp_ack_timer;
+	struct mptcp_options_received rx_opt;
+
+	/* Only used when closing the subflow */
+	struct delayed_work work;
+
+	/* MP_JOIN subflow we initiated: timer for retransmitting the 3rd ack.
+	 * Allocated by mptcp_init4/6_subsockets, NULL for the other subflows.
+	 */
+	struct timer_list *mptcp_ack_timer;
+};
+
+/* SHA1-states after hashing the first block of the inner and the outer hash
+ * of HMAC-SHA1. They only depend on the key (see mptcp_hmac_init).
+ */
+struct mptcp_hmac_key {
+	u32	ipad[SHA_DIGEST_WORDS];
+	u32	opad[SHA_DIGEST_WORDS];
 };
 
 struct mptcp_cb {
+	/* Hot fields of the data-path first, the handshake and path-manager
+	 * state afterwards.
+	 */
 	struct sock *meta_sk;
 
 	/* list of sockets in this multipath connection */
 	struct tcp_sock *connection_list;
 
+	/* Master socket, also part of the connection_list, this
+	 * socket is the one that the application sees.
+	 */
+	struct sock *master_sk;
+
 	/* High-order bits of 64-bit sequence numbers */
 	u32 snd_high_order[2];
 	u32 rcv_high_order[2];
@@ -208,21 +248,35 @@ struct mptcp_cb {
 		dfin_combined:1,   /* Was the DFIN combined with subflow-fin? */
 		passive_close:1,
 		snd_hiseq_index:1, /* Index in snd_high_order of snd_nxt */
-		rcv_hiseq_index:1; /* Index in rcv_high_order of rcv_nxt */
+		rcv_hiseq_index:1, /* Index in rcv_high_order of rcv_nxt */
+		rcv_wnd_limited:1; /* Window limited by the rcvbuf in this
+				    * period of mptcp_rcv_space_adjust
+				    */
 
 	/* socket count in this connection */
 	u8 cnt_subflows;
 	u8 cnt_established;
 
-	u32 noneligible;	/* Path mask of temporarily non
+	u8 dfin_path_index;
+	/* Next pi to pick up in case a new path becomes available */
+	u8 next_path_index;
+
+	u64 noneligible;	/* Path mask of temporarily non
 				 * eligible subflows by the scheduler
 				 */
 
+	/* Packet scheduler of this connection */
+	struct mptcp_sched_ops *sched_ops;
+
+	u64 path_index_bits;
+	u64 remove_addrs;	/* Bit-field of address-ids */
+	u64 csum_cutoff_seq;
+
 	struct sk_buff_head reinject_queue;
 
-	u16 remove_addrs;
+	/* Index of meta_tp->out_of_order_queue, ordered by data-seq */
+	struct rb_root ofo_rb;
 
-	u8 dfin_path_index;
 	/* Worker struct for subflow establishment */
 	struct work_struct subflow_work;
 	struct delayed_work subflow_retry_work;
@@ -234,18 +288,15 @@ struct mptcp_cb {
 	 */
 	struct mutex mutex;
 
-	/* Master socket, also part of the connection_list, this
-	 * socket is the one that the application sees.
-	 */
-	struct sock *master_sk;
-
-	u64	csum_cutoff_seq;
-
 	__u64	mptcp_loc_key;
-	__u32	mptcp_loc_token;
 	__u64	mptcp_rem_key;
+	__u32	mptcp_loc_token;
 	__u32	mptcp_rem_token;
 
+	/* HMAC-keys of MP_JOIN: local key || remote key, and the reverse */
+	struct mptcp_hmac_key hmac_loc;
+	struct mptcp_hmac_key hmac_rem;
+
 	/* Create a new subflow - necessary because the meta-sk may be IPv4, but
 	 * the new subflow can be IPv6
 	 */
@@ -253,25 +304,40 @@ struct mptcp_cb {
 				      struct request_sock *req,
 				      struct dst_entry *dst);
 
-	/* Local addresses */
-	struct mptcp_loc4 locaddr4[MPTCP_MAX_ADDR];
-	u8 loc4_bits; /* Bitfield indicating which of the above addrs are set */
+	/* Local addresses. The arrays hold *_size entries. They start in the
+	 * *_init storage below and grow on demand (see mptcp_addr_reserve).
+	 */
+	struct mptcp_loc4 *locaddr4;
+	u32 loc4_bits; /* Bitfield indicating which of the above addrs are set */
+	u8 locaddr4_size;
 	u8 next_v4_index;
 
-	struct mptcp_loc6 locaddr6[MPTCP_MAX_ADDR];
-	u8 loc6_bits;
+	struct mptcp_loc6 *locaddr6;
+	u32 loc6_bits;
+	u8 locaddr6_size;
 	u8 next_v6_index;
 
 	/* Remove addresses */
-	struct mptcp_rem4 remaddr4[MPTCP_MAX_ADDR];
-	u8 rem4_bits;
+	struct mptcp_rem4 *remaddr4;
+	u32 rem4_bits;
+	u8 remaddr4_size;
 
-	struct mptcp_rem6 remaddr6[MPTCP_MAX_ADDR];
-	u8 rem6_bits;
+	struct mptcp_rem6 *remaddr6;
+	u32 rem6_bits;
+	u8 remaddr6_size;
 
-	u32 path_index_bits;
-	/* Next pi to pick up in case a new path becomes available */
-	u8 next_path_index;
+	struct mptcp_loc4 locaddr4_init[MPTCP_INIT_ADDR];
+	struct mptcp_loc6 locaddr6_init[MPTCP_INIT_ADDR];
+	struct mptcp_rem4 remaddr4_init[MPTCP_INIT_ADDR];
+	struct mptcp_rem6 remaddr6_init[MPTCP_INIT_ADDR];
+
+	/* Linkage in the per-netns path-manager state (see mptcp_pm.c):
+	 * the list of connections and the index of the local addresses.
+	 */
+	struct list_head pm_list;
+	struct list_head pm_addrs;
+	/* Spares the allocation (and its failure) for the initial address */
+	struct mptcp_pm_addr pm_addr0;
 
 	/* Original snd/rcvbuf of the initial subflow.
 	 * Used for the new subflows on the server-side to allow correct
@@ -282,9 +348,12 @@ struct mptcp_cb {
 	u32 orig_window_clamp;
 };
 
-static inline int mptcp_pi_to_flag(int pi)
+/* Path-indices go from 1 to MPTCP_MAX_PATH_INDEX, 0 is the meta-sk */
+#define MPTCP_MAX_PATH_INDEX	63
+
+static inline u64 mptcp_pi_to_flag(int pi)
 {
-	return 1 << (pi - 1);
+	return 1ULL << (pi - 1);
 }
 
 #define MPTCP_SUB_CAPABLE			0
@@ -561,7 +630,7 @@ struct mp_prio {
 	__u8	addr_id;
 } __attribute__((__packed__));
 
-static inline int mptcp_sub_len_remove_addr(u16 bitfield)
+static inline int mptcp_sub_len_remove_addr(u64 bitfield)
 {
 	unsigned int c;
 	for (c = 0; bitfield; c++)
@@ -569,7 +638,7 @@ static inline int mptcp_sub_len_remove_addr(u16 bitfield)
 	return MPTCP_SUB_LEN_REMOVE_ADDR + c - 1;
 }
 
-static inline int mptcp_sub_len_remove_addr_align(u16 bitfield)
+static inline int mptcp_sub_len_remove_addr_align(u64 bitfield)
 {
 	return ALIGN(mptcp_sub_len_remove_addr(bitfield), 4);
 }
@@ -589,9 +658,38 @@ extern int sysctl_mptcp_enabled;
 extern int sysctl_mptcp_checksum;
 extern int sysctl_mptcp_debug;
 extern int sysctl_mptcp_syn_retries;
+extern int sysctl_mptcp_pm_netlink;
 
 extern struct workqueue_struct *mptcp_wq;
 
+/* The packet scheduler decides which segment is sent next on the meta-level
+ * and on which subflow it gets sent. All callbacks are called with the
+ * meta-socket locked.
+ *
+ * get_subflow:  returns the subflow on which skb should be sent, or NULL
+ *		 if none is currently available. skb may be NULL, in which
+ *		 case any subflow able to send is fine.
+ * next_segment: returns the next skb to be scheduled, either from the
+ *		 reinject-queue (*reinject = 1), the send-head of the meta
+ *		 (*reinject = 0) or an opportunistic retransmission
+ *		 (*reinject = -1).
+ * init/release: optional, called on the meta-sk when the scheduler gets
+ *		 attached to/detached from a connection.
+ */
+struct mptcp_sched_ops {
+	struct list_head	list;
+
+	struct sock *		(*get_subflow)(struct sock *meta_sk,
+					       struct sk_buff *skb);
+	struct sk_buff *	(*next_segment)(struct sock *meta_sk,
+						int *reinject);
+	void			(*init)(struct sock *meta_sk);
+	void			(*release)(struct sock *meta_sk);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+};
+
 #define mptcp_debug(fmt, args...)					\
 	do {								\
 		if (unlikely(sysctl_mptcp_debug))			\
@@ -616,7 +714,7 @@ extern struct workqueue_struct *mptcp_wq;
 
 /* Iterates over all bit set to 1 in a bitset */
 #define mptcp_for_each_bit_set(b, i)					\
-	for (i = ffs(b) - 1; i >= 0; i = ffs(b >> (i + 1) << (i + 1)) - 1)
+	for (i = ffs(b) - 1; i >= 0; i = ffs((b) >> (i) >> 1 << (i) << 1) - 1)
 
 #define mptcp_for_each_bit_unset(b, i)					\
 	mptcp_for_each_bit_set(~b, i)
@@ -638,11 +736,16 @@ void mptcp_del_sock(struct sock *sk);
 void mptcp_update_metasocket(struct sock *sock, struct sock *meta_sk);
 void mptcp_reinject_data(struct sock *orig_sk, int clone_it);
 void mptcp_update_sndbuf(struct mptcp_cb *mpcb);
-struct sk_buff *mptcp_next_segment(struct sock *sk, int *reinject);
+void mptcp_get_meta_info(const struct sock *meta_sk,
+			 struct mptcp_meta_info *info);
+void mptcp_get_sub_info(const struct sock *sk, struct mptcp_sub_info *info);
+void mptcp_get_diag_info(const struct sock *sk, struct mptcp_diag_info *info);
 void mptcp_send_fin(struct sock *meta_sk);
 void mptcp_send_active_reset(struct sock *meta_sk, gfp_t priority);
 int mptcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 		     int push_one, gfp_t gfp);
+int mptcp_gro_receive(const struct tcphdr *th, const struct tcphdr *th2);
+void mptcp_gro_update_dss(struct tcphdr *th2, const struct tcphdr *th);
 void mptcp_parse_options(const uint8_t *ptr, int opsize,
 			 struct tcp_options_received *opt_rx,
 			 struct mptcp_options_received *mopt,
@@ -674,7 +777,8 @@ void mptcp_select_initial_window(int *__space, __u32 *window_clamp,
 unsigned int mptcp_current_mss(struct sock *meta_sk);
 int mptcp_select_size(const struct sock *meta_sk);
 void mptcp_key_sha1(u64 key, u32 *token, u64 *idsn);
-void mptcp_hmac_sha1(u8 *key_1, u8 *key_2, u8 *rand_1, u8 *rand_2,
+void mptcp_hmac_init(struct mptcp_hmac_key *hk, u8 *key_1, u8 *key_2);
+void mptcp_hmac_sha1(const struct mptcp_hmac_key *hk, u8 *rand_1, u8 *rand_2,
 		     u32 *hash_out);
 void mptcp_clean_rtx_infinite(struct sk_buff *skb, struct sock *sk);
 void mptcp_fin(struct sock *meta_sk);
@@ -688,7 +792,7 @@ int mptcp_backlog_rcv(struct sock *meta_sk, struct sk_buff *skb);
 struct sock *mptcp_sk_clone(const struct sock *sk, int family, const gfp_t priority);
 void mptcp_ack_handler(unsigned long);
 void mptcp_set_keepalive(struct sock *sk, int val);
-int mptcp_check_rtt(const struct tcp_sock *tp, int time);
+void mptcp_rcv_space_adjust(struct sock *meta_sk);
 int mptcp_check_snd_buf(const struct tcp_sock *tp);
 int mptcp_handle_options(struct sock *sk, const struct tcphdr *th, struct sk_buff *skb);
 void __init mptcp_init(void);
@@ -697,7 +801,41 @@ int mptcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 		   unsigned int mss_now, int reinject);
 int mptso_fragment(struct sock *sk, struct sk_buff *skb, unsigned int len,
 		   unsigned int mss_now, gfp_t gfp, int reinject);
+int mptcp_sk_can_sg(const struct sock *meta_sk);
+int mptcp_sk_can_sendpage(const struct sock *meta_sk);
+int mptcp_sk_can_gso(const struct sock *meta_sk);
 void mptcp_destroy_sock(struct sock *sk);
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_get_default_scheduler(char *name);
+int mptcp_set_default_scheduler(const char *name);
+int mptcp_set_scheduler(struct sock *sk, const char *name);
+void mptcp_init_scheduler(struct mptcp_cb *mpcb);
+void mptcp_cleanup_scheduler(struct mptcp_cb *mpcb);
+void __init mptcp_sched_init(void);
+int mptcp_is_available(struct sock *sk, struct sk_buff *skb);
+int mptcp_dont_reinject_skb(struct tcp_sock *tp, struct sk_buff *skb);
+struct sock *mptcp_default_get_subflow(struct sock *meta_sk,
+				       struct sk_buff *skb);
+struct sk_buff *mptcp_default_next_segment(struct sock *meta_sk, int *reinject);
+struct sk_buff *mptcp_rcv_buf_optimization(struct sock *sk, int penal);
+
+static inline void *mptcp_sched_priv(const struct tcp_sock *tp)
+{
+	return (void *)tp->mptcp->mptcp_sched;
+}
+
+static inline struct sock *mptcp_get_subflow(struct sock *meta_sk,
+					     struct sk_buff *skb)
+{
+	return tcp_sk(meta_sk)->mpcb->sched_ops->get_subflow(meta_sk, skb);
+}
+
+static inline struct sk_buff *mptcp_next_segment(struct sock *meta_sk,
+						 int *reinject)
+{
+	return tcp_sk(meta_sk)->mpcb->sched_ops->next_segment(meta_sk, reinject);
+}
 
 static inline void mptcp_push_pending_frames(struct sock *meta_sk)
 {
@@ -805,24 +943,25 @@ static inline int is_master_tp(const struct tcp_sock *tp)
 
 static inline void mptcp_hash_request_remove(struct request_sock *req)
 {
+	spinlock_t *lock = &mptcp_reqsk_hlock[mptcp_rsk(req)->collide_hash];
 	int in_softirq = 0;
 
 	if (list_empty(&mptcp_rsk(req)->collide_tuple))
 		return;
 
 	if (in_softirq()) {
-		spin_lock(&mptcp_reqsk_hlock);
+		spin_lock(lock);
 		in_softirq = 1;
 	} else {
-		spin_lock_bh(&mptcp_reqsk_hlock);
+		spin_lock_bh(lock);
 	}
 
 	list_del(&mptcp_rsk(req)->collide_tuple);
 
 	if (in_softirq)
-		spin_unlock(&mptcp_reqsk_hlock);
+		spin_unlock(lock);
 	else
-		spin_unlock_bh(&mptcp_reqsk_hlock);
+		spin_unlock_bh(lock);
 }
 
 static inline void mptcp_reqsk_destructor(struct request_sock *req)
@@ -834,11 +973,9 @@ static inline void mptcp_reqsk_destructor(struct request_sock *req)
 		if (in_softirq()) {
 			mptcp_reqsk_remove_tk(req);
 		} else {
-			rcu_read_lock_bh();
-			spin_lock(&mptcp_tk_hashlock);
-			hlist_nulls_del_rcu(&mptcp_rsk(req)->collide_tk);
-			spin_unlock(&mptcp_tk_hashlock);
-			rcu_read_unlock_bh();
+			local_bh_disable();
+			mptcp_reqsk_remove_tk(req);
+			local_bh_enable();
 		}
 	} else {
 		mptcp_hash_request_remove(req);
@@ -866,6 +1003,7 @@ static inline void mptcp_init_mp_opt(struct mptcp_options_received *mopt)
 	mopt->mp_fail = 0;
 	mopt->mp_fclose = 0;
 	mopt->mpcb = NULL;
+	mopt->mptcp_echo_key = 0;
 }
 
 static inline void mptcp_reset_mopt(struct tcp_sock *tp)
@@ -950,6 +1088,9 @@ static inline void mptcp_init_buffer_space(struct sock *sk)
 		tcp_sk(meta_sk)->rcv_ssthresh += tcp_sk(sk)->rcv_ssthresh;
 		meta_sk->sk_rcvbuf = space;
 	}
+
+	/* Start of the delivery-measurement of mptcp_rcv_space_adjust() */
+	tcp_sk(sk)->rcvq_space.seq = tcp_sk(sk)->rcv_nxt;
 }
 
 static inline void mptcp_set_rto(struct sock *sk)
@@ -1024,27 +1165,28 @@ static inline int mptcp_fallback_infinite(struct sock *sk, int flag)
 	return 0;
 }
 
-/* Find the first free index in the bitfield */
-static inline int __mptcp_find_free_index(u8 bitfield, int j, u8 base)
+/* Find the first free index in the bitfield, starting at base */
+static inline int __mptcp_find_free_index(u32 bitfield, int j, u8 base)
 {
-	int i;
-	mptcp_for_each_bit_unset(bitfield >> base, i) {
-		/* We wrapped at the bitfield - try from 0 on */
-		if (i + base >= sizeof(bitfield) * 8) {
-			mptcp_for_each_bit_unset(bitfield, i) {
-				if (i != j)
-					return i;
-			}
-			goto exit;
-		}
-		if (i + base != j)
-			return i + base;
+	int i, bits = sizeof(bitfield) * 8;
+
+	if (base >= bits)
+		base = 0;
+
+	for (i = base; i < bits; i++) {
+		if (!(bitfield & (1U << i)) && i != j)
+			return i;
+	}
+	/* We wrapped at the bitfield - try from 0 on */
+	for (i = 0; i < base; i++) {
+		if (!(bitfield & (1U << i)) && i != j)
+			return i;
 	}
-exit:
+
 	return -1;
 }
 
-static inline int mptcp_find_free_index(u8 bitfield)
+static inline int mptcp_find_free_index(u32 bitfield)
 {
 	return __mptcp_find_free_index(bitfield, -1, 0);
 }
@@ -1052,24 +1194,18 @@ static inline int mptcp_find_free_index(u8 bitfield)
 /* Find the first index whose bit in the bit-field == 0 */
 static inline u8 mptcp_set_new_pathindex(struct mptcp_cb *mpcb)
 {
-	u8 base = mpcb->next_path_index;
-	int i;
+	int base = mpcb->next_path_index ? : 1;
+	int i, j;
 
-	/* Start at 1, because 0 is reserved for the meta-sk */
-	mptcp_for_each_bit_unset(mpcb->path_index_bits >> base, i) {
-		if (i + base < 1)
-			continue;
-		if (i + base >= sizeof(mpcb->path_index_bits) * 8)
-			break;
-		i += base;
-		mpcb->path_index_bits |= (1 << i);
-		mpcb->next_path_index = i + 1;
-		return i;
-	}
-	mptcp_for_each_bit_unset(mpcb->path_index_bits, i) {
-		if (i < 1)
+	/* Start at next_path_index and wrap around. 0 is reserved for the
+	 * meta-sk.
+	 */
+	for (j = 0; j < MPTCP_MAX_PATH_INDEX; j++) {
+		i = (base - 1 + j) % MPTCP_MAX_PATH_INDEX + 1;
+		if (mpcb->path_index_bits & (1ULL << i))
 			continue;
-		mpcb->path_index_bits |= (1 << i);
+
+		mpcb->path_index_bits |= (1ULL << i);
 		mpcb->next_path_index = i + 1;
 		return i;
 	}
@@ -1150,6 +1286,13 @@ static inline void mptcp_parse_options(const uint8_t *ptr, const int opsize,
 				       const struct tcp_options_received *opt_rx,
 				       const struct mptcp_options_received *mopt,
 				       const struct sk_buff *skb) {}
+static inline int mptcp_gro_receive(const struct tcphdr *th,
+				    const struct tcphdr *th2)
+{
+	return 0;
+}
+static inline void mptcp_gro_update_dss(struct tcphdr *th2,
+					const struct tcphdr *th) {}
 static inline void mptcp_syn_options(struct sock *sk,
 				     struct tcp_out_options *opts,
 				     unsigned *remaining) {}
@@ -1207,10 +1350,7 @@ static inline int mptcp_fallback_infinite(const struct sock *sk, int flag)
 	return 0;
 }
 static inline void mptcp_init_mp_opt(const struct mptcp_options_received *mopt) {}
-static inline int mptcp_check_rtt(const struct tcp_sock *tp, int time)
-{
-	return 0;
-}
+static inline void mptcp_rcv_space_adjust(struct sock *meta_sk) {}
 static inline int mptcp_check_snd_buf(const struct tcp_sock *tp)
 {
 	return 0;
@@ -1256,7 +1396,23 @@ static inline int mptso_fragment(struct sock *sk, struct sk_buff *skb,
 {
 	return 0;
 }
+static inline int mptcp_sk_can_sg(const struct sock *sk)
+{
+	return 0;
+}
+static inline int mptcp_sk_can_sendpage(const struct sock *sk)
+{
+	return 0;
+}
+static inline int mptcp_sk_can_gso(const struct sock *sk)
+{
+	return 0;
+}
 static inline void mptcp_destroy_sock(struct sock *sk) {}
+static inline int mptcp_set_scheduler(struct sock *sk, const char *name)
+{
+	return -EOPNOTSUPP;
+}
 #endif /* CONFIG_MPTCP */
 
 #endif /* _MPTCP_H */
@@ -42,12 +42,25 @@
 #include <net/sock.h>
 #include <net/tcp.h>
 
-/* Max number of local or remote addresses we can store.
- * When changing, see the bitfield below in mptcp_loc4/6. */
-#define MPTCP_MAX_ADDR	8
+/* Max number of local or remote addresses we can store, per family.
+ * When changing, see the bitfields below in mptcp_rem4/6 and the u32
+ * loc/rem-bits in the mptcp_cb. The address-ids of the IPv6 local
+ * addresses start at MPTCP_MAX_ADDR, thus they must fit in mpcb->remove_addrs.
+ */
+#define MPTCP_MAX_ADDR	32
+/* Number of addresses per family, stored without additional allocation */
+#define MPTCP_INIT_ADDR	2
 
 #define MPTCP_SUBFLOW_RETRY_DELAY	1000
 
+/* Make sure that mpcb->array[index] exists, growing the array if needed.
+ * Returns 0 on success.
+ */
+#define mptcp_addr_reserve(mpcb, array, index)				\
+	__mptcp_addr_reserve((void **)&(mpcb)->array, (mpcb)->array##_init,	\
+			     &(mpcb)->array##_size, sizeof(*(mpcb)->array),	\
+			     index)
+
 struct mptcp_loc4 {
 	u8		id;
 	u8		low_prio:1;
@@ -57,8 +70,8 @@ struct mptcp_loc4 {
 
 struct mptcp_rem4 {
 	u8		id;
-	u8		bitfield;
-	u8		retry_bitfield;
+	u32		bitfield;	/* Index of the local addrs already used */
+	u32		retry_bitfield;
 	__be16		port;
 	struct in_addr	addr;
 };
@@ -72,12 +85,39 @@ struct mptcp_loc6 {
 
 struct mptcp_rem6 {
 	u8		id;
-	u8		bitfield;
-	u8		retry_bitfield;
+	u32		bitfield;	/* Index of the local addrs already used */
+	u32		retry_bitfield;
 	__be16		port;
 	struct in6_addr	addr;
 };
 
+union mptcp_pm_inet_addr {
+	struct in_addr	in;
+	struct in6_addr	in6;
+};
+
+/* A local address of an mpcb, as linked in the per-netns address-index.
+ * It allows an address-event to reach only the mpcbs using the address.
+ */
+struct mptcp_pm_addr {
+	struct hlist_node	hash;	/* In the per-netns address-index */
+	struct list_head	list;	/* In mpcb->pm_addrs */
+	struct mptcp_cb		*mpcb;
+	sa_family_t		family;
+	union mptcp_pm_inet_addr addr;
+};
+
+/* An address-event, deferred to the per-netns path-manager worker */
+struct mptcp_addr_event {
+	struct list_head	list;
+	sa_family_t		family;
+	u8			code;		/* NETDEV_UP/DOWN/CHANGE */
+	u8			down_first:1,	/* Went down before being code */
+				low_prio:1,	/* The interface is IFF_MPBACKUP */
+				if_running:1;
+	union mptcp_pm_inet_addr addr;
+};
+
 struct mptcp_cb;
 #ifdef CONFIG_MPTCP
 
@@ -89,19 +129,14 @@ struct mptcp_cb;
  * to retrieve the mpcb.
  */
 extern struct list_head mptcp_reqsk_htb[MPTCP_HASH_SIZE];
-extern spinlock_t mptcp_reqsk_hlock;	/* hashtable protection */
-
-/* Lock, protecting the two hash-tables that hold the token. Namely,
- * mptcp_reqsk_tk_htb and tk_hashtable
- */
-extern spinlock_t mptcp_tk_hashlock;	/* hashtable protection */
+extern spinlock_t mptcp_reqsk_hlock[MPTCP_HASH_SIZE];	/* per-bucket lock */
 
 void mptcp_create_subflows(struct sock *meta_sk);
 void mptcp_create_subflow_worker(struct work_struct *work);
 void mptcp_retry_subflow_worker(struct work_struct *work);
 struct mp_join *mptcp_find_join(struct sk_buff *skb);
 u8 mptcp_get_loc_addrid(struct mptcp_cb *mpcb, struct sock *sk);
-void __mptcp_hash_insert(struct tcp_sock *meta_tp, u32 token);
+void mptcp_hash_insert(struct tcp_sock *meta_tp, u32 token);
 void mptcp_hash_remove_bh(struct tcp_sock *meta_tp);
 void mptcp_hash_remove(struct tcp_sock *meta_tp);
 struct sock *mptcp_hash_find(struct net *net, u32 token);
@@ -112,12 +147,36 @@ void mptcp_reqsk_remove_tk(struct request_sock *reqsk);
 void mptcp_reqsk_new_mptcp(struct request_sock *req,
 			   const struct tcp_options_received *rx_opt,
 			   const struct mptcp_options_received *mopt);
+void mptcp_reqsk_new_cookie(struct request_sock *req,
+			    const struct mptcp_options_received *mopt,
+			    const struct sk_buff *skb, u32 cookie);
+int mptcp_reqsk_init_cookie(struct request_sock *req,
+			    const struct mptcp_options_received *mopt,
+			    const struct sk_buff *skb);
 void mptcp_connect_init(struct tcp_sock *tp);
 void mptcp_set_addresses(struct sock *meta_sk);
+int __mptcp_addr_reserve(void **array, void *init, u8 *size, size_t elem_size,
+			 int index);
+void mptcp_addr_free(struct mptcp_cb *mpcb);
+void mptcp_pm_conn_add(struct mptcp_cb *mpcb);
+int mptcp_pm_addr_index(struct mptcp_cb *mpcb, sa_family_t family,
+			const void *addr);
+void mptcp_pm_addr_unindex(struct mptcp_cb *mpcb, sa_family_t family,
+			   const void *addr);
 int mptcp_check_req(struct sk_buff *skb, struct net *net);
 void mptcp_address_worker(struct work_struct *work);
-int mptcp_pm_addr_event_handler(unsigned long event, void *ptr, int family);
-int mptcp_pm_init(void);
+int mptcp_pm_addr_event_handler(struct net *net,
+				const struct mptcp_addr_event *event);
+void mptcp_pm_apply_event(const struct mptcp_addr_event *event,
+			  struct mptcp_cb *mpcb);
+void mptcp_genl_conn_event(struct sock *meta_sk, u8 cmd);
+void mptcp_genl_sub_event(struct sock *sk, u8 cmd);
+void mptcp_genl_addr_event(const struct mptcp_cb *mpcb, u8 cmd,
+			   sa_family_t family, const void *addr, __be16 port,
+			   u8 id);
+int __init mptcp_genl_init(void);
+void mptcp_genl_undo(void);
+int __init mptcp_pm_init(void);
 void mptcp_pm_undo(void);
 
 #else /* CONFIG_MPTCP */
@@ -125,6 +184,16 @@ static inline void mptcp_reqsk_new_mptcp(struct request_sock *req,
 					 const struct tcp_options_received *rx_opt,
 					 const struct mptcp_options_received *mopt)
 {}
+static inline void mptcp_reqsk_new_cookie(struct request_sock *req,
+					  const struct mptcp_options_received *mopt,
+					  const struct sk_buff *skb, u32 cookie)
+{}
+static inline int mptcp_reqsk_init_cookie(struct request_sock *req,
+					  const struct mptcp_options_received *mopt,
+					  const struct sk_buff *skb)
+{
+	return -1;
+}
 static inline void mptcp_hash_remove(struct tcp_sock *meta_tp) {}
 #endif /* CONFIG_MPTCP */
 
@@ -52,7 +52,9 @@ struct sock *mptcp_v4_search_req(const __be16 rport, const __be32 raddr,
 				 const __be32 laddr, const struct net *net);
 int mptcp_init4_subsockets(struct sock *meta_sk, const struct mptcp_loc4 *loc,
 			   struct mptcp_rem4 *rem);
-void mptcp_pm_addr4_event_handler(struct in_ifaddr *ifa, unsigned long event,
+int mptcp_v4_fill_addr_event(struct in_ifaddr *ifa, unsigned long event,
+			     struct mptcp_addr_event *ev);
+void mptcp_pm_addr4_event_handler(const struct mptcp_addr_event *event,
 				  struct mptcp_cb *mpcb);
 int mptcp_pm_v4_init(void);
 void mptcp_pm_v4_undo(void);
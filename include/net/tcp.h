@@ -719,6 +719,11 @@ extern u32 __tcp_select_window(struct sock *sk);
 #define MPTCPHDR_SEQ64_OFO	0x20 /* Is it not in our circular array? */
 #define MPTCPHDR_SEQ64_INDEX	0x40 /* Index of seq in mpcb->snd_high_order */
 #define MPTCPHDR_DSS_CSUM	0x80
+/* Only on received skbs, thus sharing its bit with MPTCPHDR_INF (only used on
+ * the send-side): skb->csum holds the checksum of the TCP segment, computed
+ * when TCP verified it (see __tcp_checksum_complete).
+ */
+#define MPTCPHDR_CSUM_SEG	0x08
 
 /* It is impossible, that all 8 bits of mptcp_flags are set to 1 with the above
  * Thus, defining MPTCPHDR_JOIN as 0xFF is safe.
@@ -740,7 +745,8 @@ struct tcp_skb_cb {
 #endif
 		} header;	/* For incoming frames		*/
 #ifdef CONFIG_MPTCP
-		__u32 path_mask; /* path indices that tried to send this skb */
+		__u64 path_mask; /* path indices that tried to send this skb */
+		struct rb_node ofo_node; /* meta-level out-of-order queue */
 #endif
 	};
 	__u32		seq;		/* Starting sequence number	*/
@@ -1002,10 +1008,35 @@ static inline __sum16 tcp_v4_check(int len, __be32 saddr,
 	return csum_tcpudp_magic(saddr,daddr,len,IPPROTO_TCP,base);
 }
 
+#ifdef CONFIG_MPTCP
+/* As __skb_checksum_complete, but we keep the checksum of the segment in
+ * skb->csum. Thus, the DSS-checksum of MPTCP does not need to read the
+ * payload a second time.
+ */
+static inline __sum16 __tcp_checksum_complete(struct sk_buff *skb)
+{
+	__wsum csum;
+	__sum16 sum;
+
+	if (skb->ip_summed == CHECKSUM_COMPLETE ||
+	    skb->data != skb_transport_header(skb))
+		return __skb_checksum_complete(skb);
+
+	csum = skb_checksum(skb, 0, skb->len, 0);
+	sum = csum_fold(csum_add(skb->csum, csum));
+	if (likely(!sum)) {
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		skb->csum = csum;
+		TCP_SKB_CB(skb)->mptcp_flags |= MPTCPHDR_CSUM_SEG;
+	}
+	return sum;
+}
+#else
 static inline __sum16 __tcp_checksum_complete(struct sk_buff *skb)
 {
 	return __skb_checksum_complete(skb);
 }
+#endif
 
 static inline int tcp_checksum_complete(struct sk_buff *skb)
 {
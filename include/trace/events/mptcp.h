@@ -0,0 +1,259 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mptcp
+
+#if !defined(_TRACE_MPTCP_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MPTCP_H
+
+#include <linux/skbuff.h>
+#include <linux/tracepoint.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+
+/*
+ * The connection is identified by its local token, the subflow by its
+ * path-index. Sequence numbers are the 32-bit data-level ones.
+ */
+
+/*
+ * Tracepoint for the subflow chosen by the packet scheduler. sk is NULL if
+ * no subflow is available. skb is NULL if the scheduler is queried for
+ * the receive-buffer optimization.
+ */
+TRACE_EVENT(mptcp_sched_subflow,
+
+	TP_PROTO(struct sock *meta_sk, struct sock *sk, struct sk_buff *skb),
+
+	TP_ARGS(meta_sk, sk, skb),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u32,	srtt		)
+		__field(	u32,	snd_cwnd	)
+		__field(	u32,	packets_out	)
+		__field(	u32,	seq		)
+		__field(	u32,	end_seq		)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(meta_sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = sk ? tcp_sk(sk)->mptcp->path_index : 0;
+		__entry->srtt = sk ? jiffies_to_usecs(tcp_sk(sk)->srtt) >> 3 : 0;
+		__entry->snd_cwnd = sk ? tcp_sk(sk)->snd_cwnd : 0;
+		__entry->packets_out = sk ? tcp_sk(sk)->packets_out : 0;
+		__entry->seq = skb ? TCP_SKB_CB(skb)->seq : 0;
+		__entry->end_seq = skb ? TCP_SKB_CB(skb)->end_seq : 0;
+	),
+
+	TP_printk("token=%#x pi=%u srtt=%uus cwnd=%u out=%u seq=%u end_seq=%u",
+		__entry->token, __entry->path_index, __entry->srtt,
+		__entry->snd_cwnd, __entry->packets_out, __entry->seq,
+		__entry->end_seq)
+);
+
+/*
+ * Tracepoint for a segment going to the reinject-queue. sk is the subflow
+ * it has been sent on, NULL if it comes from the meta-level.
+ */
+TRACE_EVENT(mptcp_reinject,
+
+	TP_PROTO(struct sock *meta_sk, struct sock *sk, struct sk_buff *skb),
+
+	TP_ARGS(meta_sk, sk, skb),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u32,	seq		)
+		__field(	u32,	end_seq		)
+		__field(	u32,	snd_una		)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(meta_sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = sk ? tcp_sk(sk)->mptcp->path_index : 0;
+		__entry->seq = TCP_SKB_CB(skb)->seq;
+		__entry->end_seq = TCP_SKB_CB(skb)->end_seq;
+		__entry->snd_una = tcp_sk(meta_sk)->snd_una;
+	),
+
+	TP_printk("token=%#x pi=%u seq=%u end_seq=%u snd_una=%u",
+		__entry->token, __entry->path_index, __entry->seq,
+		__entry->end_seq, __entry->snd_una)
+);
+
+/*
+ * Tracepoint for the receive-buffer optimization halving the cwnd of the
+ * subflow slow_sk, which holds back the head of the meta send-queue.
+ */
+TRACE_EVENT(mptcp_rcvbuf_penal,
+
+	TP_PROTO(struct sock *sk, struct sock *slow_sk),
+
+	TP_ARGS(sk, slow_sk),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u8,	slow_path_index	)
+		__field(	u32,	srtt		)
+		__field(	u32,	slow_srtt	)
+		__field(	u32,	slow_cwnd	)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = tcp_sk(sk)->mptcp->path_index;
+		__entry->slow_path_index = tcp_sk(slow_sk)->mptcp->path_index;
+		__entry->srtt = jiffies_to_usecs(tcp_sk(sk)->srtt) >> 3;
+		__entry->slow_srtt = jiffies_to_usecs(tcp_sk(slow_sk)->srtt) >> 3;
+		__entry->slow_cwnd = tcp_sk(slow_sk)->snd_cwnd;
+	),
+
+	TP_printk("token=%#x pi=%u srtt=%uus slow_pi=%u slow_srtt=%uus slow_cwnd=%u",
+		__entry->token, __entry->path_index, __entry->srtt,
+		__entry->slow_path_index, __entry->slow_srtt,
+		__entry->slow_cwnd)
+);
+
+/*
+ * Tracepoint for the receive-buffer optimization retransmitting the head
+ * of the meta send-queue on the subflow sk.
+ */
+TRACE_EVENT(mptcp_rcvbuf_retrans,
+
+	TP_PROTO(struct sock *sk, struct sk_buff *skb, int penal),
+
+	TP_ARGS(sk, skb, penal),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u8,	penal		)
+		__field(	u32,	srtt		)
+		__field(	u32,	snd_cwnd	)
+		__field(	u32,	seq		)
+		__field(	u32,	end_seq		)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = tcp_sk(sk)->mptcp->path_index;
+		__entry->penal = penal;
+		__entry->srtt = jiffies_to_usecs(tcp_sk(sk)->srtt) >> 3;
+		__entry->snd_cwnd = tcp_sk(sk)->snd_cwnd;
+		__entry->seq = TCP_SKB_CB(skb)->seq;
+		__entry->end_seq = TCP_SKB_CB(skb)->end_seq;
+	),
+
+	TP_printk("token=%#x pi=%u penal=%u srtt=%uus cwnd=%u seq=%u end_seq=%u",
+		__entry->token, __entry->path_index, __entry->penal,
+		__entry->srtt, __entry->snd_cwnd, __entry->seq,
+		__entry->end_seq)
+);
+
+/*
+ * Tracepoint for a new DSS-mapping installed on the subflow sk.
+ */
+TRACE_EVENT(mptcp_mapping,
+
+	TP_PROTO(struct sock *sk),
+
+	TP_ARGS(sk),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u64,	data_seq	)
+		__field(	u32,	subseq		)
+		__field(	u16,	data_len	)
+		__field(	u8,	data_fin	)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = tcp_sk(sk)->mptcp->path_index;
+		__entry->data_seq = tcp_sk(sk)->mptcp->map_data_seq;
+		__entry->subseq = tcp_sk(sk)->mptcp->map_subseq -
+				  tcp_sk(sk)->mptcp->rcv_isn;
+		__entry->data_len = tcp_sk(sk)->mptcp->map_data_len;
+		__entry->data_fin = tcp_sk(sk)->mptcp->map_data_fin;
+	),
+
+	TP_printk("token=%#x pi=%u data_seq=%llu subseq=%u len=%u dfin=%u",
+		__entry->token, __entry->path_index,
+		(unsigned long long)__entry->data_seq, __entry->subseq,
+		__entry->data_len, __entry->data_fin)
+);
+
+/*
+ * Tracepoint for a segment, received on the subflow sk, going to the meta
+ * out-of-order queue.
+ */
+TRACE_EVENT(mptcp_ofo_queue,
+
+	TP_PROTO(struct sock *meta_sk, struct sock *sk, struct sk_buff *skb),
+
+	TP_ARGS(meta_sk, sk, skb),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u32,	seq		)
+		__field(	u32,	end_seq		)
+		__field(	u32,	rcv_nxt		)
+		__field(	u32,	qlen		)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(meta_sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = tcp_sk(sk)->mptcp->path_index;
+		__entry->seq = TCP_SKB_CB(skb)->seq;
+		__entry->end_seq = TCP_SKB_CB(skb)->end_seq;
+		__entry->rcv_nxt = tcp_sk(meta_sk)->rcv_nxt;
+		__entry->qlen = skb_queue_len(&tcp_sk(meta_sk)->out_of_order_queue);
+	),
+
+	TP_printk("token=%#x pi=%u seq=%u end_seq=%u rcv_nxt=%u qlen=%u",
+		__entry->token, __entry->path_index, __entry->seq,
+		__entry->end_seq, __entry->rcv_nxt, __entry->qlen)
+);
+
+/*
+ * Tracepoint for the meta-level retransmission timer. sk is the subflow
+ * the head of the send-queue is retransmitted on, NULL if none is
+ * available.
+ */
+TRACE_EVENT(mptcp_retransmit_timer,
+
+	TP_PROTO(struct sock *meta_sk, struct sock *sk),
+
+	TP_ARGS(meta_sk, sk),
+
+	TP_STRUCT__entry(
+		__field(	u32,	token		)
+		__field(	u8,	path_index	)
+		__field(	u8,	retransmits	)
+		__field(	u32,	rto		)
+		__field(	u32,	snd_una		)
+		__field(	u32,	snd_nxt		)
+	),
+
+	TP_fast_assign(
+		__entry->token = tcp_sk(meta_sk)->mpcb->mptcp_loc_token;
+		__entry->path_index = sk ? tcp_sk(sk)->mptcp->path_index : 0;
+		__entry->retransmits = inet_csk(meta_sk)->icsk_retransmits;
+		__entry->rto = jiffies_to_msecs(inet_csk(meta_sk)->icsk_rto);
+		__entry->snd_una = tcp_sk(meta_sk)->snd_una;
+		__entry->snd_nxt = tcp_sk(meta_sk)->snd_nxt;
+	),
+
+	TP_printk("token=%#x pi=%u retransmits=%u rto=%ums snd_una=%u snd_nxt=%u",
+		__entry->token, __entry->path_index, __entry->retransmits,
+		__entry->rto, __entry->snd_una, __entry->snd_nxt)
+);
+
+#endif /* _TRACE_MPTCP_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -20,6 +20,7 @@
 #include <linux/time.h>
 
 #include <net/icmp.h>
+#include <net/mptcp.h>
 #include <net/tcp.h>
 #include <net/ipv6.h>
 #include <net/inet_common.h>
@@ -108,6 +109,17 @@ static int inet_csk_diag_fill(struct sock *sk,
 		       icsk->icsk_ca_ops->name);
 	}
 
+#ifdef CONFIG_MPTCP
+	if ((ext & (1 << (INET_DIAG_MPTCPINFO - 1))) &&
+	    sk->sk_protocol == IPPROTO_TCP && tcp_sk(sk)->mpc) {
+		struct mptcp_diag_info *mpinfo;
+
+		mpinfo = INET_DIAG_PUT(skb, INET_DIAG_MPTCPINFO,
+				       sizeof(*mpinfo));
+		mptcp_get_diag_info(sk, mpinfo);
+	}
+#endif
+
 	r->idiag_family = sk->sk_family;
 	r->idiag_state = sk->sk_state;
 	r->idiag_timer = 0;
@@ -254,6 +254,15 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPDeferAcceptDrop", LINUX_MIB_TCPDEFERACCEPTDROP),
 	SNMP_MIB_ITEM("IPReversePathFilter", LINUX_MIB_IPRPFILTER),
 	SNMP_MIB_ITEM("TCPTimeWaitOverflow", LINUX_MIB_TCPTIMEWAITOVERFLOW),
+	SNMP_MIB_ITEM("MPTCPOFOQueue", LINUX_MIB_MPTCPOFOQUEUE),
+	SNMP_MIB_ITEM("MPTCPOFOQueueSteps", LINUX_MIB_MPTCPOFOQUEUESTEPS),
+	SNMP_MIB_ITEM("MPTCPOFOMerge", LINUX_MIB_MPTCPOFOMERGE),
+	SNMP_MIB_ITEM("MPTCPWinUpdate", LINUX_MIB_MPTCPWINUPDATE),
+	SNMP_MIB_ITEM("MPTCPWinUpdateSaved", LINUX_MIB_MPTCPWINUPDATESAVED),
+	SNMP_MIB_ITEM("MPTCPRcvBufGrow", LINUX_MIB_MPTCPRCVBUFGROW),
+	SNMP_MIB_ITEM("MPTCPRcvBufShrink", LINUX_MIB_MPTCPRCVBUFSHRINK),
+	SNMP_MIB_ITEM("MPTCPRcvWndLimited", LINUX_MIB_MPTCPRCVWNDLIMITED),
+	SNMP_MIB_ITEM("MPTCPFastPathRcv", LINUX_MIB_MPTCPFASTPATHRCV),
 	SNMP_MIB_SENTINEL
 };
 
@@ -17,6 +17,8 @@
 #include <linux/kernel.h>
 #include <net/tcp.h>
 #include <net/route.h>
+#include <net/mptcp.h>
+#include <net/mptcp_v4.h>
 
 /* Timestamps: lowest bits store TCP options */
 #define TSBITS 6
@@ -206,16 +208,29 @@ static inline int cookie_check(struct sk_buff *skb, __u32 cookie)
 
 static inline struct sock *get_cookie_sock(struct sock *sk, struct sk_buff *skb,
 					   struct request_sock *req,
-					   struct dst_entry *dst)
+					   struct dst_entry *dst,
+					   struct mptcp_options_received *mopt)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct sock *child;
+	int ret;
 
 	child = icsk->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
-	if (child)
-		inet_csk_reqsk_queue_add(sk, req, child);
-	else
+	if (!child) {
 		reqsk_free(req);
+		return NULL;
+	}
+
+	/* Like tcp_check_req(), MPTCP hands over the master-subflow */
+	ret = mptcp_check_req_master(sk, child, req, NULL, mopt);
+	if (ret < 0) {
+		reqsk_free(req);
+		return NULL;
+	}
+	if (!ret)
+		return tcp_sk(child)->mpcb->master_sk;
+
+	inet_csk_reqsk_queue_add(sk, req, child);
 
 	return child;
 }
@@ -265,7 +280,8 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 			     struct ip_options *opt)
 {
 	struct tcp_options_received tcp_opt;
-	u8 *hash_location;
+	struct mptcp_options_received mopt;
+	const u8 *hash_location;
 	struct inet_request_sock *ireq;
 	struct tcp_request_sock *treq;
 	struct tcp_sock *tp = tcp_sk(sk);
@@ -292,13 +308,19 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 
 	/* check for timestamp cookie support */
 	memset(&tcp_opt, 0, sizeof(tcp_opt));
-	tcp_parse_options(skb, &tcp_opt, &hash_location, NULL, 0);
+	mptcp_init_mp_opt(&mopt);
+	tcp_parse_options(skb, &tcp_opt, &hash_location, &mopt, 0);
 
 	if (!cookie_check_timestamp(&tcp_opt, &ecn_ok))
 		goto out;
 
 	ret = NULL;
-	req = inet_reqsk_alloc(&tcp_request_sock_ops); /* for safety */
+#ifdef CONFIG_MPTCP
+	if (mopt.saw_mpc)
+		req = inet_reqsk_alloc(&mptcp_request_sock_ops);
+	else
+#endif
+		req = inet_reqsk_alloc(&tcp_request_sock_ops); /* for safety */
 	if (!req)
 		goto out;
 
@@ -306,6 +328,7 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 	treq = tcp_rsk(req);
 	treq->rcv_isn		= ntohl(th->seq) - 1;
 	treq->snt_isn		= cookie;
+	treq->saw_mpc		= 0;
 	req->mss		= mss;
 	ireq->loc_port		= th->dest;
 	ireq->rmt_port		= th->source;
@@ -318,6 +341,12 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 	ireq->tstamp_ok		= tcp_opt.saw_tstamp;
 	req->ts_recent		= tcp_opt.saw_tstamp ? tcp_opt.rcv_tsval : 0;
 
+	/* The third ACK of MP_CAPABLE echoes the keys and the checksum-flag.
+	 * If it does not match the cookie, we fall back to regular TCP.
+	 */
+	if (mopt.saw_mpc)
+		mptcp_reqsk_init_cookie(req, &mopt, skb);
+
 	/* We throwed the options of the initial SYN away, so we hope
 	 * the ACK carries the same options again (see RFC1122 4.2.3.8)
 	 */
@@ -367,7 +396,7 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 
 	ireq->rcv_wscale  = rcv_wscale;
 
-	ret = get_cookie_sock(sk, skb, req, &rt->dst);
+	ret = get_cookie_sock(sk, skb, req, &rt->dst, &mopt);
 	/* ip_queue_xmit() depends on our flow being setup
 	 * Normal sockets get it right from inet_csk_route_child_sock()
 	 */
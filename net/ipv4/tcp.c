@@ -741,12 +741,17 @@ static unsigned int tcp_xmit_size_goal(struct sock *sk, u32 mss_now,
 
 	xmit_size_goal = mss_now;
 
-	if (large_allowed && sk_can_gso(sk) && !tp->mpc) {
+	if (large_allowed &&
+	    (tp->mpc ? mptcp_sk_can_gso(sk) : sk_can_gso(sk))) {
 		xmit_size_goal = ((sk->sk_gso_max_size - 1) -
 				  inet_csk(sk)->icsk_af_ops->net_header_len -
 				  inet_csk(sk)->icsk_ext_hdr_len -
 				  tp->tcp_header_len);
 
+		/* Each subflow-segment carries a DSS-option */
+		if (tp->mpc)
+			xmit_size_goal -= MPTCP_SUB_LEN_DSM_ALIGN;
+
 		xmit_size_goal = tcp_bound_to_half_wnd(tp, xmit_size_goal);
 
 		/* We try hard to avoid divides here */
@@ -896,12 +901,24 @@ int tcp_sendpage(struct sock *sk, struct page *page, int offset,
 {
 	ssize_t res;
 
-	if (!(sk->sk_route_caps & NETIF_F_SG) ||
-	    !(sk->sk_route_caps & NETIF_F_ALL_CSUM) || tcp_sk(sk)->mpc)
+	if (!tcp_sk(sk)->mpc &&
+	    (!(sk->sk_route_caps & NETIF_F_SG) ||
+	     !(sk->sk_route_caps & NETIF_F_ALL_CSUM)))
 		return sock_no_sendpage(sk->sk_socket, page, offset, size,
 					flags);
 
 	lock_sock(sk);
+
+	/* MPTCP: the subflow-skbs share the pages of the meta-skb. Checksums
+	 * computed in software (DSS or TCP) would get stale if the pages
+	 * change before a retransmission.
+	 */
+	if (tcp_sk(sk)->mpc && !mptcp_sk_can_sendpage(sk)) {
+		release_sock(sk);
+		return sock_no_sendpage(sk->sk_socket, page, offset, size,
+					flags);
+	}
+
 	res = do_tcp_sendpages(sk, &page, offset, size, flags);
 	release_sock(sk);
 	return res;
@@ -920,7 +937,10 @@ static inline int select_size(struct sock *sk, int sg)
 		tmp = mptcp_select_size(sk);
 
 	if (sg) {
-		if (sk_can_gso(sk))
+		/* MPTCP: the subflow-skbs share the pages of the meta-skb.
+		 * Linear data would have to be copied for each of them.
+		 */
+		if (tp->mpc || sk_can_gso(sk))
 			tmp = 0;
 		else {
 			int pgbreak = SKB_MAX_HEAD(MAX_TCP_HEADER);
@@ -979,10 +999,10 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		goto out_err;
 
 	if (tp->mpc)
-		/* At the moment we assume sg is unavailable on any interface.
-		 * In the future we should set sg to 1 if *all* interfaces support sg
+		/* Only use sg if *all* subflows support it, as the segment
+		 * may get scheduled on any of them.
 		 */
-		sg = 0;
+		sg = mptcp_sk_can_sg(sk);
 	else
 		sg = sk->sk_route_caps & NETIF_F_SG;
 
@@ -2147,7 +2167,10 @@ int tcp_disconnect(struct sock *sk, int flags)
 	tcp_clear_xmit_timers(sk);
 	__skb_queue_purge(&sk->sk_receive_queue);
 	tcp_write_queue_purge(sk);
-	__skb_queue_purge(&tp->out_of_order_queue);
+	if (is_meta_sk(sk))
+		mptcp_purge_ofo_queue(tp);
+	else
+		__skb_queue_purge(&tp->out_of_order_queue);
 #ifdef CONFIG_NET_DMA
 	__skb_queue_purge(&sk->sk_async_wait_queue);
 #endif
@@ -2258,6 +2281,24 @@ static int do_tcp_setsockopt(struct sock *sk, int level,
 		release_sock(sk);
 		return err;
 	}
+	case TCP_MULTIPATH_SCHEDULER: {
+		char name[MPTCP_SCHED_NAME_MAX];
+
+		if (optlen < 1)
+			return -EINVAL;
+
+		val = strncpy_from_user(name, optval,
+					min_t(long, MPTCP_SCHED_NAME_MAX - 1,
+					      optlen));
+		if (val < 0)
+			return -EFAULT;
+		name[val] = 0;
+
+		lock_sock(sk);
+		err = mptcp_set_scheduler(sk, name);
+		release_sock(sk);
+		return err;
+	}
 	case TCP_COOKIE_TRANSACTIONS: {
 		struct tcp_cookie_transactions ctd;
 		struct tcp_cookie_values *cvp = NULL;
@@ -2754,6 +2795,70 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 			return -EFAULT;
 		return 0;
 	}
+	case TCP_MULTIPATH_SCHEDULER: {
+		char name[MPTCP_SCHED_NAME_MAX];
+
+		if (tp->mpcb && tp->mpcb->sched_ops)
+			strlcpy(name, tp->mpcb->sched_ops->name,
+				MPTCP_SCHED_NAME_MAX);
+		else if (tp->mptcp_sched_name[0])
+			strlcpy(name, tp->mptcp_sched_name,
+				MPTCP_SCHED_NAME_MAX);
+		else
+			mptcp_get_default_scheduler(name);
+
+		if (get_user(len, optlen))
+			return -EFAULT;
+		len = min_t(unsigned int, len, MPTCP_SCHED_NAME_MAX);
+		if (put_user(len, optlen))
+			return -EFAULT;
+		if (copy_to_user(optval, name, len))
+			return -EFAULT;
+		return 0;
+	}
+	case TCP_MULTIPATH_INFO: {
+		struct mptcp_meta_info meta_info;
+		struct mptcp_sub_info sub_info;
+		struct sock *sk_it;
+		int bytes_written, err = 0;
+
+		if (get_user(len, optlen))
+			return -EFAULT;
+		if (!tp->mpc || !tp->mpcb)
+			return -EOPNOTSUPP;
+		if (len < 0 || len < sizeof(meta_info))
+			return -EINVAL;
+
+		/* The subflow-list must not change while we walk it */
+		lock_sock(sk);
+
+		mptcp_get_meta_info(sk, &meta_info);
+		if (copy_to_user(optval, &meta_info, sizeof(meta_info))) {
+			err = -EFAULT;
+			goto out_info;
+		}
+		bytes_written = sizeof(meta_info);
+
+		mptcp_for_each_sk(tp->mpcb, sk_it) {
+			if (len < bytes_written + sizeof(sub_info))
+				break;
+
+			mptcp_get_sub_info(sk_it, &sub_info);
+			if (copy_to_user(optval + bytes_written, &sub_info,
+					 sizeof(sub_info))) {
+				err = -EFAULT;
+				goto out_info;
+			}
+			bytes_written += sizeof(sub_info);
+		}
+out_info:
+		release_sock(sk);
+		if (err)
+			return err;
+		if (put_user(bytes_written, optlen))
+			return -EFAULT;
+		return 0;
+	}
 	case TCP_MULTIPATH_SUBFLOWS: {
 		// TODO: how to behave for non-mptcp? return 1 subflow or error?
 		struct mptcp_cb *mpcb = tp->mpcb;
@@ -2934,6 +3039,8 @@ struct sk_buff **tcp_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 	unsigned int hlen;
 	unsigned int off;
 	int flush = 1;
+	int optflush = 0;
+	int dss_merge = 0;
 	int i;
 
 	off = skb_gro_offset(skb);
@@ -2984,14 +3091,22 @@ found:
 		  ~(TCP_FLAG_CWR | TCP_FLAG_FIN | TCP_FLAG_PSH));
 	flush |= (__force int)(th->ack_seq ^ th2->ack_seq);
 	for (i = sizeof(*th); i < thlen; i += 4)
-		flush |= *(u32 *)((u8 *)th + i) ^
-			 *(u32 *)((u8 *)th2 + i);
+		optflush |= *(u32 *)((u8 *)th + i) ^
+			    *(u32 *)((u8 *)th2 + i);
 
 	mss = skb_shinfo(p)->gso_size;
 
 	flush |= (len - 1) >= mss;
 	flush |= (ntohl(th2->seq) + skb_gro_len(p)) ^ ntohl(th->seq);
 
+	/* Segments of the same DSS-mapping can still be merged */
+	if (optflush && !flush) {
+		dss_merge = mptcp_gro_receive(th, th2);
+		if (dss_merge)
+			optflush = 0;
+	}
+	flush |= optflush;
+
 	if (flush || skb_gro_receive(head, skb)) {
 		mss = 1;
 		goto out_check_final;
@@ -3000,6 +3115,8 @@ found:
 	p = *head;
 	th2 = tcp_hdr(p);
 	tcp_flag_word(th2) |= flags & (TCP_FLAG_FIN | TCP_FLAG_PSH);
+	if (dss_merge)
+		mptcp_gro_update_dss(th2, th);
 
 out_check_final:
 	flush = len < mss;
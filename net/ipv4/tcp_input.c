@@ -497,14 +497,16 @@ void tcp_rcv_space_adjust(struct sock *sk)
 	int time;
 	int space;
 
+	if (tp->mpc) {
+		mptcp_rcv_space_adjust(sk);
+		return;
+	}
+
 	if (tp->rcvq_space.time == 0)
 		goto new_measure;
 
 	time = tcp_time_stamp - tp->rcvq_space.time;
-	if (tp->mpc) {
-		if (mptcp_check_rtt(tp, time))
-			return;
-	} else if (time < (tp->rcv_rtt_est.rtt >> 3) || tp->rcv_rtt_est.rtt == 0)
+	if (time < (tp->rcv_rtt_est.rtt >> 3) || tp->rcv_rtt_est.rtt == 0)
 		return;
 
 	space = 2 * (tp->copied_seq - tp->rcvq_space.seq);
@@ -4749,6 +4751,9 @@ restart:
 		memcpy(nskb->head, skb->head, header);
 		memcpy(nskb->cb, skb->cb, sizeof(skb->cb));
 		TCP_SKB_CB(nskb)->seq = TCP_SKB_CB(nskb)->end_seq = start;
+#ifdef CONFIG_MPTCP
+		TCP_SKB_CB(nskb)->mptcp_flags &= ~MPTCPHDR_CSUM_SEG;
+#endif
 		__skb_queue_before(list, skb, nskb);
 		skb_set_owner_r(nskb, sk);
 
@@ -5656,8 +5661,7 @@ static int tcp_rcv_synsent_state_process(struct sock *sk, struct sk_buff *skb,
 			u8 hash_mac_check[20];
 			struct mptcp_cb *mpcb = tp->mpcb;
 
-			mptcp_hmac_sha1((u8 *)&mpcb->mptcp_rem_key,
-					(u8 *)&mpcb->mptcp_loc_key,
+			mptcp_hmac_sha1(&mpcb->hmac_rem,
 					(u8 *)&tp->mptcp->rx_opt.mptcp_recv_nonce,
 					(u8 *)&tp->mptcp->mptcp_loc_nonce,
 					(u32 *)hash_mac_check);
@@ -5722,7 +5726,7 @@ static int tcp_rcv_synsent_state_process(struct sock *sk, struct sk_buff *skb,
 			 * arrives. Used only when establishing an additional
 			 * subflow inside of an MPTCP connection.
 			 */
-			sk_reset_timer(sk, &tp->mptcp->mptcp_ack_timer,
+			sk_reset_timer(sk, tp->mptcp->mptcp_ack_timer,
 				       jiffies + icsk->icsk_rto);
 		}
 
@@ -969,8 +969,12 @@ void tcp_queue_skb(struct sock *sk, struct sk_buff *skb)
 void tcp_set_skb_tso_segs(const struct sock *sk, struct sk_buff *skb,
 			  unsigned int mss_now)
 {
-	if (skb->len <= mss_now || !sk_can_gso(sk) ||
-	    skb->ip_summed == CHECKSUM_NONE || tcp_sk(sk)->mpc) {
+	/* The meta-sk never transmits by itself. Its segments get segmented
+	 * according to the capabilities of the subflow they are sent on (see
+	 * mptcp_write_xmit).
+	 */
+	if (skb->len <= mss_now || skb->ip_summed == CHECKSUM_NONE ||
+	    (!sk_can_gso(sk) && !is_meta_sk(sk))) {
 		/* Avoid the costly divide in the normal
 		 * non-TSO case.
 		 */
@@ -1044,7 +1048,7 @@ int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 	u8 flags;
 
 	if (tcp_sk(sk)->mpc && mptcp_is_data_seq(skb))
-		mptcp_fragment(sk, skb, len, mss_now, 0);
+		return mptcp_fragment(sk, skb, len, mss_now, 0);
 
 	if (WARN_ON(len > skb->len))
 		return -EINVAL;
@@ -1532,7 +1536,7 @@ static int tso_fragment(struct sock *sk, struct sk_buff *skb, unsigned int len,
 	u8 flags;
 
 	if (tcp_sk(sk)->mpc && mptcp_is_data_seq(skb))
-		mptso_fragment(sk, skb, len, mss_now, gfp, 0);
+		return mptso_fragment(sk, skb, len, mss_now, gfp, 0);
 
 	/* All of a TSO frame must be composed of paged data.  */
 	if (skb->len != skb->data_len)
@@ -20,6 +20,8 @@
 #include <linux/kernel.h>
 #include <net/ipv6.h>
 #include <net/tcp.h>
+#include <net/mptcp.h>
+#include <net/mptcp_v6.h>
 
 extern int sysctl_tcp_syncookies;
 extern __u32 syncookie_secret[2][16-4+SHA_DIGEST_WORDS];
@@ -49,16 +51,29 @@ static __u16 const msstab[] = {
 
 static inline struct sock *get_cookie_sock(struct sock *sk, struct sk_buff *skb,
 					   struct request_sock *req,
-					   struct dst_entry *dst)
+					   struct dst_entry *dst,
+					   struct mptcp_options_received *mopt)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct sock *child;
+	int ret;
 
 	child = icsk->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
-	if (child)
-		inet_csk_reqsk_queue_add(sk, req, child);
-	else
+	if (!child) {
 		reqsk_free(req);
+		return NULL;
+	}
+
+	/* Like tcp_check_req(), MPTCP hands over the master-subflow */
+	ret = mptcp_check_req_master(sk, child, req, NULL, mopt);
+	if (ret < 0) {
+		reqsk_free(req);
+		return NULL;
+	}
+	if (!ret)
+		return tcp_sk(child)->mpcb->master_sk;
+
+	inet_csk_reqsk_queue_add(sk, req, child);
 
 	return child;
 }
@@ -152,7 +167,8 @@ static inline int cookie_check(struct sk_buff *skb, __u32 cookie)
 struct sock *cookie_v6_check(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_options_received tcp_opt;
-	u8 *hash_location;
+	struct mptcp_options_received mopt;
+	const u8 *hash_location;
 	struct inet_request_sock *ireq;
 	struct inet6_request_sock *ireq6;
 	struct tcp_request_sock *treq;
@@ -180,13 +196,19 @@ struct sock *cookie_v6_check(struct sock *sk, struct sk_buff *skb)
 
 	/* check for timestamp cookie support */
 	memset(&tcp_opt, 0, sizeof(tcp_opt));
-	tcp_parse_options(skb, &tcp_opt, &hash_location, NULL, 0);
+	mptcp_init_mp_opt(&mopt);
+	tcp_parse_options(skb, &tcp_opt, &hash_location, &mopt, 0);
 
 	if (!cookie_check_timestamp(&tcp_opt, &ecn_ok))
 		goto out;
 
 	ret = NULL;
-	req = inet6_reqsk_alloc(&tcp6_request_sock_ops);
+#ifdef CONFIG_MPTCP
+	if (mopt.saw_mpc)
+		req = inet6_reqsk_alloc(&mptcp6_request_sock_ops);
+	else
+#endif
+		req = inet6_reqsk_alloc(&tcp6_request_sock_ops);
 	if (!req)
 		goto out;
 
@@ -225,6 +247,13 @@ struct sock *cookie_v6_check(struct sock *sk, struct sk_buff *skb)
 	req->ts_recent		= tcp_opt.saw_tstamp ? tcp_opt.rcv_tsval : 0;
 	treq->rcv_isn = ntohl(th->seq) - 1;
 	treq->snt_isn = cookie;
+	treq->saw_mpc = 0;
+
+	/* The third ACK of MP_CAPABLE echoes the keys and the checksum-flag.
+	 * If it does not match the cookie, we fall back to regular TCP.
+	 */
+	if (mopt.saw_mpc)
+		mptcp_reqsk_init_cookie(req, &mopt, skb);
 
 	/*
 	 * We need to lookup the dst_entry to get the correct window size.
@@ -258,7 +287,7 @@ struct sock *cookie_v6_check(struct sock *sk, struct sk_buff *skb)
 
 	ireq->rcv_wscale = rcv_wscale;
 
-	ret = get_cookie_sock(sk, skb, req, dst);
+	ret = get_cookie_sock(sk, skb, req, dst, &mopt);
 out:
 	return ret;
 out_free:
@@ -42,8 +42,22 @@ static int alpha_scale_den = 10;
 static int alpha_scale_num = 32;
 static int alpha_scale = 12;
 
+/* Alpha is kept in the congestion-control private data of the meta-sk.
+ *
+ * It is recalculated at most once per RTT of the fastest subflow, unless the
+ * update is forced (loss, change of the congestion-state or of the number of
+ * established subflows). In between, the subflows' cwnd's only moved by a
+ * few segments, so that the (stale) alpha stays close to the exact value.
+ *
+ * alpha_cnt caches mptcp_ccc_scale(1, alpha_scale) / alpha, the increase
+ * threshold of the snd_cwnd_cnt. This spares a division on each ACK.
+ */
 struct mptcp_ccc {
 	u64	alpha;
+	u32	alpha_cnt;
+	u32	alpha_stamp;	/* tcp_time_stamp of the last recalculation */
+	u32	alpha_rtt;	/* srtt of the fastest subflow at that time */
+	u8	alpha_subflows;	/* cnt_established at that time */
 	bool	forced_update;
 };
 
@@ -52,16 +66,25 @@ static inline int mptcp_ccc_sk_can_send(const struct sock *sk)
 	return mptcp_sk_can_send(sk) && tcp_sk(sk)->srtt;
 }
 
-static inline u64 mptcp_get_alpha(struct sock *meta_sk)
+static inline void mptcp_set_alpha(struct sock *meta_sk, u64 alpha)
 {
 	struct mptcp_ccc *mptcp_ccc = inet_csk_ca(meta_sk);
-	return mptcp_ccc->alpha;
+	mptcp_ccc->alpha = alpha;
+	mptcp_ccc->alpha_cnt = (u32)div64_u64(1ULL << alpha_scale, alpha);
 }
 
-static inline void mptcp_set_alpha(struct sock *meta_sk, u64 alpha)
+static inline u32 mptcp_get_alpha_cnt(struct sock *meta_sk)
 {
 	struct mptcp_ccc *mptcp_ccc = inet_csk_ca(meta_sk);
-	mptcp_ccc->alpha = alpha;
+
+	/* This may happen, if at the initialization, the mpcb
+	 * was not yet attached to the sock, and thus
+	 * initializing alpha failed.
+	 */
+	if (unlikely(!mptcp_ccc->alpha))
+		return 1U << alpha_scale;
+
+	return mptcp_ccc->alpha_cnt;
 }
 
 static inline u64 mptcp_ccc_scale(u32 val, int scale)
@@ -81,16 +104,37 @@ static inline void mptcp_set_forced(struct sock *meta_sk, bool force)
 	mptcp_ccc->forced_update = force;
 }
 
-static void mptcp_ccc_recalc_alpha(struct sock *sk)
+/* Is alpha still fresh enough to skip a non-forced recalculation? */
+static bool mptcp_ccc_alpha_fresh(struct sock *meta_sk,
+				  const struct mptcp_cb *mpcb)
+{
+	struct mptcp_ccc *mptcp_ccc = inet_csk_ca(meta_sk);
+
+	return mptcp_ccc->alpha_subflows == mpcb->cnt_established &&
+	       tcp_time_stamp - mptcp_ccc->alpha_stamp <
+	       (mptcp_ccc->alpha_rtt >> 3);
+}
+
+static void mptcp_ccc_recalc_alpha(struct sock *sk, bool force)
 {
 	struct mptcp_cb *mpcb = tcp_sk(sk)->mpcb;
+	struct mptcp_ccc *mptcp_ccc;
 	struct sock *sub_sk;
 	int best_cwnd = 0, best_rtt = 0, can_send = 0;
+	u32 min_rtt = 0xffffffff;
 	u64 max_numerator = 0, sum_denominator = 0, alpha = 1;
 
 	if (!mpcb)
 		return;
 
+	if (!force && mptcp_ccc_alpha_fresh(mpcb->meta_sk, mpcb))
+		return;
+
+	mptcp_ccc = inet_csk_ca(mpcb->meta_sk);
+	mptcp_ccc->alpha_stamp = tcp_time_stamp;
+	mptcp_ccc->alpha_subflows = mpcb->cnt_established;
+	mptcp_ccc->alpha_rtt = 0;
+
 	/* Only one subflow left - fall back to normal reno-behavior
 	 * (set alpha to 1) */
 	if (mpcb->cnt_established <= 1)
@@ -107,6 +151,8 @@ static void mptcp_ccc_recalc_alpha(struct sock *sk)
 			continue;
 
 		can_send++;
+		if (sub_tp->srtt < min_rtt)
+			min_rtt = sub_tp->srtt;
 
 		/* We need to look for the path, that provides the max-value.
 		 * Integer-overflow is not possible here, because
@@ -126,6 +172,8 @@ static void mptcp_ccc_recalc_alpha(struct sock *sk)
 	if (unlikely(!can_send))
 		goto exit;
 
+	mptcp_ccc->alpha_rtt = min_rtt;
+
 	/* Calculate the denominator */
 	mptcp_for_each_sk(mpcb, sub_sk) {
 		struct tcp_sock *sub_tp = tcp_sk(sub_sk);
@@ -172,7 +220,7 @@ static void mptcp_ccc_init(struct sock *sk)
 static void mptcp_ccc_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 {
 	if (event == CA_EVENT_LOSS)
-		mptcp_ccc_recalc_alpha(sk);
+		mptcp_ccc_recalc_alpha(sk, true);
 }
 
 static void mptcp_ccc_set_state(struct sock *sk, u8 ca_state)
@@ -200,27 +248,17 @@ static void mptcp_ccc_cong_avoid(struct sock *sk, u32 ack, u32 in_flight)
 	if (tp->snd_cwnd <= tp->snd_ssthresh) {
 		/* In "safe" area, increase. */
 		tcp_slow_start(tp);
-		mptcp_ccc_recalc_alpha(sk);
+		mptcp_ccc_recalc_alpha(sk, false);
 		return;
 	}
 
 	if (mptcp_get_forced(mptcp_meta_sk(sk))) {
-		mptcp_ccc_recalc_alpha(sk);
+		mptcp_ccc_recalc_alpha(sk, true);
 		mptcp_set_forced(mptcp_meta_sk(sk), 0);
 	}
 
 	if (mpcb->cnt_established > 1) {
-		u64 alpha = mptcp_get_alpha(mptcp_meta_sk(sk));
-
-		/* This may happen, if at the initialization, the mpcb
-		 * was not yet attached to the sock, and thus
-		 * initializing alpha failed.
-		 */
-		if (unlikely(!alpha))
-			alpha = 1;
-
-		snd_cwnd = (int) div_u64 ((u64) mptcp_ccc_scale(1, alpha_scale),
-						alpha);
+		snd_cwnd = (int)mptcp_get_alpha_cnt(mptcp_meta_sk(sk));
 
 		/* snd_cwnd_cnt >= max (scale * tot_cwnd / alpha, cwnd)
 		 * Thus, we select here the max value. */
@@ -242,7 +280,7 @@ static void mptcp_ccc_cong_avoid(struct sock *sk, u32 ack, u32 in_flight)
 		if (tp->snd_cwnd_cnt >= snd_cwnd) {
 			if (tp->snd_cwnd < tp->snd_cwnd_clamp) {
 				tp->snd_cwnd++;
-				mptcp_ccc_recalc_alpha(sk);
+				mptcp_ccc_recalc_alpha(sk, false);
 			}
 
 			tp->snd_cwnd_cnt = 0;
@@ -44,6 +44,7 @@
 
 #include <linux/module.h>
 #include <linux/list.h>
+#include <linux/mptcp_genl.h>
 #include <linux/jhash.h>
 #include <linux/tcp.h>
 #include <linux/net.h>
@@ -56,6 +57,12 @@
 #include <linux/sysctl.h>
 #endif
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/mptcp.h>
+
+/* Packet schedulers may be modules */
+EXPORT_TRACEPOINT_SYMBOL_GPL(mptcp_sched_subflow);
+
 static struct kmem_cache *mptcp_sock_cache __read_mostly;
 static struct kmem_cache *mptcp_cb_cache __read_mostly;
 
@@ -65,8 +72,28 @@ int sysctl_mptcp_checksum __read_mostly = 1;
 int sysctl_mptcp_debug __read_mostly;
 EXPORT_SYMBOL(sysctl_mptcp_debug);
 int sysctl_mptcp_syn_retries __read_mostly = MPTCP_SYN_RETRIES;
+int sysctl_mptcp_pm_netlink __read_mostly;
 
 #ifdef CONFIG_SYSCTL
+static int proc_mptcp_scheduler(ctl_table *ctl, int write,
+				void __user *buffer, size_t *lenp,
+				loff_t *ppos)
+{
+	char val[MPTCP_SCHED_NAME_MAX];
+	ctl_table tbl = {
+		.data = val,
+		.maxlen = MPTCP_SCHED_NAME_MAX,
+	};
+	int ret;
+
+	mptcp_get_default_scheduler(val);
+
+	ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+	if (write && ret == 0)
+		ret = mptcp_set_default_scheduler(val);
+	return ret;
+}
+
 static struct ctl_table mptcp_table[] = {
 	{
 		.procname = "mptcp_ndiffports",
@@ -103,6 +130,19 @@ static struct ctl_table mptcp_table[] = {
 		.mode = 0644,
 		.proc_handler = &proc_dointvec
 	},
+	{
+		.procname = "mptcp_pm_netlink",
+		.data = &sysctl_mptcp_pm_netlink,
+		.maxlen = sizeof(int),
+		.mode = 0644,
+		.proc_handler = &proc_dointvec
+	},
+	{
+		.procname = "mptcp_scheduler",
+		.mode = 0644,
+		.maxlen = MPTCP_SCHED_NAME_MAX,
+		.proc_handler = proc_mptcp_scheduler,
+	},
 	{ }
 };
 #endif
@@ -134,6 +174,7 @@ struct sock *mptcp_select_ack_sock(const struct sock *meta_sk, int copied)
 	 */
 	short max_data_seq_set = 0;
 	u32 min_time = 0xffffffff;
+	int ack_pending = 0;
 
 	/* How do we select the subflow to send the window-update on?
 	 *
@@ -143,7 +184,9 @@ struct sock *mptcp_select_ack_sock(const struct sock *meta_sk, int copied)
 	 *    (this guarantees a working subflow)
 	 *    a) its latest data_seq received is after the original
 	 *       copied_seq.
-	 *       We select the one with the lowest rtt, so that the
+	 *       We prefer one with a delayed ACK pending, because the
+	 *       window-update then also serves as its ACK. Among them, we
+	 *       select the one with the lowest rtt, so that the
 	 *       window-update reaches our peer the fastest.
 	 *    b) if no subflow has this kind of data_seq (e.g., very
 	 *       strange meta-level retransmissions going on), we take
@@ -159,7 +202,11 @@ struct sock *mptcp_select_ack_sock(const struct sock *meta_sk, int copied)
 		 * current receive-queue.
 		 */
 		if (copied && after(tp->mptcp->last_data_seq, meta_tp->copied_seq - copied)) {
-			if (tp->srtt < min_time) {
+			int pending = !!inet_csk_ack_scheduled(sk);
+
+			if (pending > ack_pending ||
+			    (pending == ack_pending && tp->srtt < min_time)) {
+				ack_pending = pending;
 				min_time = tp->srtt;
 				subsk = sk;
 				max_data_seq_set = 0;
@@ -222,6 +269,8 @@ static void mptcp_sock_destruct(struct sock *sk)
 {
 	inet_sock_destruct(sk);
 
+	/* A pending timer holds a reference on sk, thus it is not running */
+	kfree(tcp_sk(sk)->mptcp->mptcp_ack_timer);
 	kmem_cache_free(mptcp_sock_cache, tcp_sk(sk)->mptcp);
 	tcp_sk(sk)->mptcp = NULL;
 
@@ -229,6 +278,8 @@ static void mptcp_sock_destruct(struct sock *sk)
 		/* Taken when mpcb pointer was set */
 		sock_put(mptcp_meta_sk(sk));
 	} else {
+		mptcp_cleanup_scheduler(tcp_sk(sk)->mpcb);
+		mptcp_addr_free(tcp_sk(sk)->mpcb);
 		kmem_cache_free(mptcp_cb_cache, tcp_sk(sk)->mpcb);
 
 		mptcp_debug("%s destroying meta-sk\n", __func__);
@@ -240,6 +291,10 @@ void mptcp_destroy_sock(struct sock *sk)
 	if (is_meta_sk(sk)) {
 		struct sock *sk_it, *tmpsk;
 
+		/* Only if MPTCP_EVENT_CREATED has been sent */
+		if (!list_empty(&tcp_sk(sk)->mpcb->pm_list))
+			mptcp_genl_conn_event(sk, MPTCP_EVENT_CLOSED);
+
 		__skb_queue_purge(&tcp_sk(sk)->mpcb->reinject_queue);
 		mptcp_purge_ofo_queue(tcp_sk(sk));
 
@@ -278,8 +333,10 @@ static void mptcp_set_state(struct sock *sk)
 		meta_sk->sk_state_change(meta_sk);
 	}
 
-	if (sk->sk_state == TCP_ESTABLISHED)
+	if (sk->sk_state == TCP_ESTABLISHED) {
 		tcp_sk(sk)->mpcb->cnt_established++;
+		mptcp_genl_sub_event(sk, MPTCP_EVENT_SUB_ESTABLISHED);
+	}
 }
 
 void mptcp_set_keepalive(struct sock *sk, int val)
@@ -320,15 +377,16 @@ void mptcp_key_sha1(u64 key, u32 *token, u64 *idsn)
 		*idsn = *((u64 *)&mptcp_hashed_key[3]);
 }
 
-void mptcp_hmac_sha1(u8 *key_1, u8 *key_2, u8 *rand_1, u8 *rand_2,
-		       u32 *hash_out)
+/* Hashes the first block of the inner and the outer hash of HMAC-SHA1, with
+ * key_1 || key_2 as key. As the keys are fixed for the lifetime of the
+ * connection, mptcp_hmac_sha1 then only has to hash the nonces.
+ */
+void mptcp_hmac_init(struct mptcp_hmac_key *hk, u8 *key_1, u8 *key_2)
 {
 	u32 workspace[SHA_WORKSPACE_WORDS];
-	u8 input[128]; /* 2 512-bit blocks */
+	u8 input[64];
 	int i;
 
-	memset(workspace, 0, sizeof(workspace));
-
 	/* Generate key xored with ipad */
 	memset(input, 0x36, 64);
 	for (i = 0; i < 8; i++)
@@ -336,46 +394,58 @@ void mptcp_hmac_sha1(u8 *key_1, u8 *key_2, u8 *rand_1, u8 *rand_2,
 	for (i = 0; i < 8; i++)
 		input[i + 8] ^= key_2[i];
 
-	memcpy(&input[64], rand_1, 4);
-	memcpy(&input[68], rand_2, 4);
-	input[72] = 0x80; /* Padding: First bit after message = 1 */
-	memset(&input[73], 0, 53);
+	sha_init(hk->ipad);
+	sha_transform(hk->ipad, input, workspace);
 
-	/* Padding: Length of the message = 512 + 64 bits */
-	input[126] = 0x02;
-	input[127] = 0x40;
+	/* Generate key xored with opad */
+	memset(input, 0x5C, 64);
+	for (i = 0; i < 8; i++)
+		input[i] ^= key_1[i];
+	for (i = 0; i < 8; i++)
+		input[i + 8] ^= key_2[i];
 
-	sha_init(hash_out);
-	sha_transform(hash_out, input, workspace);
-	memset(workspace, 0, sizeof(workspace));
+	sha_init(hk->opad);
+	sha_transform(hk->opad, input, workspace);
 
-	sha_transform(hash_out, &input[64], workspace);
 	memset(workspace, 0, sizeof(workspace));
+}
+
+void mptcp_hmac_sha1(const struct mptcp_hmac_key *hk, u8 *rand_1, u8 *rand_2,
+		     u32 *hash_out)
+{
+	u32 workspace[SHA_WORKSPACE_WORDS];
+	u8 input[64];
+	int i;
+
+	/* Inner hash, its first block is in hk->ipad */
+	memcpy(&input[0], rand_1, 4);
+	memcpy(&input[4], rand_2, 4);
+	input[8] = 0x80; /* Padding: First bit after message = 1 */
+	memset(&input[9], 0, 53);
+
+	/* Padding: Length of the message = 512 + 64 bits */
+	input[62] = 0x02;
+	input[63] = 0x40;
+
+	memcpy(hash_out, hk->ipad, sizeof(hk->ipad));
+	sha_transform(hash_out, input, workspace);
 
 	for (i = 0; i < 5; i++)
 		hash_out[i] = cpu_to_be32(hash_out[i]);
 
-	/* Prepare second part of hmac */
-	memset(input, 0x5C, 64);
-	for (i = 0; i < 8; i++)
-		input[i] ^= key_1[i];
-	for (i = 0; i < 8; i++)
-		input[i + 8] ^= key_2[i];
-
-	memcpy(&input[64], hash_out, 20);
-	input[84] = 0x80;
-	memset(&input[85], 0, 41);
+	/* Outer hash, its first block is in hk->opad */
+	memcpy(input, hash_out, 20);
+	input[20] = 0x80;
+	memset(&input[21], 0, 41);
 
 	/* Padding: Length of the message = 512 + 160 bits */
-	input[126] = 0x02;
-	input[127] = 0xA0;
+	input[62] = 0x02;
+	input[63] = 0xA0;
 
-	sha_init(hash_out);
+	memcpy(hash_out, hk->opad, sizeof(hk->opad));
 	sha_transform(hash_out, input, workspace);
 	memset(workspace, 0, sizeof(workspace));
 
-	sha_transform(hash_out, &input[64], workspace);
-
 	for (i = 0; i < 5; i++)
 		hash_out[i] = cpu_to_be32(hash_out[i]);
 }
@@ -717,6 +787,12 @@ int mptcp_alloc_mpcb(struct sock *meta_sk, __u64 remote_key, u32 window)
 	meta_tp->rcv_nxt = (u32) idsn;
 	meta_tp->rcv_wup = (u32) idsn;
 
+	/* Precompute the keyed part of the MP_JOIN HMACs */
+	mptcp_hmac_init(&mpcb->hmac_loc, (u8 *)&mpcb->mptcp_loc_key,
+			(u8 *)&mpcb->mptcp_rem_key);
+	mptcp_hmac_init(&mpcb->hmac_rem, (u8 *)&mpcb->mptcp_rem_key,
+			(u8 *)&mpcb->mptcp_loc_key);
+
 	meta_tp->snd_wl1 = meta_tp->rcv_nxt - 1;
 	meta_tp->snd_wnd = window;
 
@@ -738,6 +814,18 @@ int mptcp_alloc_mpcb(struct sock *meta_sk, __u64 remote_key, u32 window)
 
 	/* Initialize the queues */
 	skb_queue_head_init(&mpcb->reinject_queue);
+	mpcb->ofo_rb = RB_ROOT;
+
+	mpcb->locaddr4 = mpcb->locaddr4_init;
+	mpcb->locaddr4_size = MPTCP_INIT_ADDR;
+	mpcb->locaddr6 = mpcb->locaddr6_init;
+	mpcb->locaddr6_size = MPTCP_INIT_ADDR;
+	mpcb->remaddr4 = mpcb->remaddr4_init;
+	mpcb->remaddr4_size = MPTCP_INIT_ADDR;
+	mpcb->remaddr6 = mpcb->remaddr6_init;
+	mpcb->remaddr6_size = MPTCP_INIT_ADDR;
+	INIT_LIST_HEAD(&mpcb->pm_list);
+	INIT_LIST_HEAD(&mpcb->pm_addrs);
 	skb_queue_head_init(&master_tp->out_of_order_queue);
 	tcp_prequeue_init(master_tp);
 
@@ -777,6 +865,8 @@ int mptcp_alloc_mpcb(struct sock *meta_sk, __u64 remote_key, u32 window)
 		return -ENOMEM;
 	}
 
+	mptcp_init_scheduler(mpcb);
+
 	/* Redefine function-pointers as the meta-sk is now fully ready */
 	meta_sk->sk_backlog_rcv = mptcp_backlog_rcv;
 	meta_sk->sk_destruct = mptcp_sock_destruct;
@@ -791,13 +881,7 @@ int mptcp_alloc_mpcb(struct sock *meta_sk, __u64 remote_key, u32 window)
 
 	if (!meta_tp->inside_tk_table) {
 		/* Adding the meta_tp in the token hashtable - coming from server-side */
-		rcu_read_lock();
-		spin_lock(&mptcp_tk_hashlock);
-
-		__mptcp_hash_insert(meta_tp, mpcb->mptcp_loc_token);
-
-		spin_unlock(&mptcp_tk_hashlock);
-		rcu_read_unlock();
+		mptcp_hash_insert(meta_tp, mpcb->mptcp_loc_token);
 	}
 	master_tp->inside_tk_table = 0;
 
@@ -853,6 +937,8 @@ struct sock *mptcp_sk_clone(const struct sock *sk, int family, const gfp_t prior
 void mptcp_fallback_meta_sk(struct sock *meta_sk)
 {
 	kfree(inet_csk(meta_sk)->icsk_accept_queue.listen_opt);
+	mptcp_cleanup_scheduler(tcp_sk(meta_sk)->mpcb);
+	mptcp_addr_free(tcp_sk(meta_sk)->mpcb);
 	kmem_cache_free(mptcp_sock_cache, tcp_sk(meta_sk)->mptcp);
 	kmem_cache_free(mptcp_cb_cache, tcp_sk(meta_sk)->mpcb);
 }
@@ -939,7 +1025,7 @@ void mptcp_del_sock(struct sock *sk)
 
 	if (tp->mptcp->pre_established) {
 		tp->mptcp->pre_established = 0;
-		sk_stop_timer(sk, &tp->mptcp->mptcp_ack_timer);
+		sk_stop_timer(sk, tp->mptcp->mptcp_ack_timer);
 	}
 
 	mpcb = tp->mpcb;
@@ -962,17 +1048,19 @@ void mptcp_del_sock(struct sock *sk)
 	mpcb->cnt_subflows--;
 	mpcb->cnt_established--;
 
+	mptcp_genl_sub_event(sk, MPTCP_EVENT_SUB_CLOSED);
+
 	tp->mptcp->next = NULL;
 	tp->mptcp->attached = 0;
-	mpcb->path_index_bits &= ~(1 << tp->mptcp->path_index);
+	mpcb->path_index_bits &= ~(1ULL << tp->mptcp->path_index);
 
 	if (!skb_queue_empty(&sk->sk_write_queue))
 		mptcp_reinject_data(sk, 0);
 
 	if (is_master_tp(tp))
 		mpcb->master_sk = NULL;
-	else
-		sk_stop_timer(sk, &tp->mptcp->mptcp_ack_timer);
+	else if (tp->mptcp->mptcp_ack_timer)
+		sk_stop_timer(sk, tp->mptcp->mptcp_ack_timer);
 
 	rcu_assign_pointer(inet_sk(sk)->inet_opt, NULL);
 }
@@ -986,6 +1074,8 @@ void mptcp_update_metasocket(struct sock *sk, struct sock *meta_sk)
 {
 	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
 
+	mptcp_pm_conn_add(mpcb);
+
 	switch (sk->sk_family) {
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	case AF_INET6:
@@ -995,6 +1085,8 @@ void mptcp_update_metasocket(struct sock *sk, struct sock *meta_sk)
 			mpcb->locaddr6[0].id = 0;
 			mpcb->locaddr6[0].port = 0;
 			mpcb->locaddr6[0].low_prio = 0;
+			/* Cannot fail, this one goes into mpcb->pm_addr0 */
+			mptcp_pm_addr_index(mpcb, AF_INET6, &mpcb->locaddr6[0].addr);
 			mpcb->loc6_bits |= 1;
 			mpcb->next_v6_index = 1;
 
@@ -1009,6 +1101,8 @@ void mptcp_update_metasocket(struct sock *sk, struct sock *meta_sk)
 		mpcb->locaddr4[0].id = 0;
 		mpcb->locaddr4[0].port = 0;
 		mpcb->locaddr4[0].low_prio = 0;
+		/* Cannot fail, this one goes into mpcb->pm_addr0 */
+		mptcp_pm_addr_index(mpcb, AF_INET, &mpcb->locaddr4[0].addr);
 		mpcb->loc4_bits |= 1;
 		mpcb->next_v4_index = 1;
 
@@ -1033,6 +1127,8 @@ void mptcp_update_metasocket(struct sock *sk, struct sock *meta_sk)
 	}
 
 	tcp_sk(sk)->mptcp->send_mp_prio = tcp_sk(sk)->mptcp->low_prio;
+
+	mptcp_genl_conn_event(meta_sk, MPTCP_EVENT_CREATED);
 }
 
 /* Clean up the receive buffer for full frames taken by the user,
@@ -1040,12 +1136,18 @@ void mptcp_update_metasocket(struct sock *sk, struct sock *meta_sk)
  * tcp_recvmsg has given to the user so far, it speeds up the
  * calculation of whether or not we must ACK for the sake of
  * a window update.
+ *
+ * The delayed ACKs are handled per subflow. The window-update however
+ * is a meta-level one and the DATA_ACK is the same on all subflows, thus
+ * a single ACK announces it - on the subflow of mptcp_select_ack_sock(),
+ * unless one of the subflow-ACKs already carried it.
  */
 void mptcp_cleanup_rbuf(struct sock *meta_sk, int copied)
 {
 	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
 	struct sock *sk;
-	__u32 rcv_window_now = 0;
+	__u32 rcv_window_now = 0, new_window;
+	int cnt_wnd = 0, acked = 0;
 
 	if (copied > 0 && !(meta_sk->sk_shutdown & RCV_SHUTDOWN)) {
 		rcv_window_now = tcp_receive_window(meta_tp);
@@ -1080,24 +1182,44 @@ void mptcp_cleanup_rbuf(struct sock *meta_sk, int copied)
 		       !icsk->icsk_ack.pingpong)) &&
 		     !atomic_read(&meta_sk->sk_rmem_alloc))) {
 			tcp_send_ack(sk);
+			acked = 1;
 			continue;
 		}
 
 second_part:
-		/* This here is the second part of tcp_cleanup_rbuf */
-		if (rcv_window_now) {
-			__u32 new_window = __tcp_select_window(sk);
-
-			/* Send ACK now, if this read freed lots of space
-			 * in our buffer. Certainly, new_window is new window.
-			 * We can advertise it now, if it is not less than
-			 * current one.
-			 * "Lots" means "at least twice" here.
-			 */
-			if (new_window && new_window >= 2 * rcv_window_now)
-				tcp_send_ack(sk);
-		}
+		/* Subflows that would announce the window-update */
+		cnt_wnd++;
 	}
+
+	/* This here is the second part of tcp_cleanup_rbuf */
+	if (!rcv_window_now || !cnt_wnd)
+		return;
+
+	sk = mptcp_select_ack_sock(meta_sk, copied);
+	if (!sk)
+		return;
+
+	new_window = __tcp_select_window(sk);
+
+	/* Send ACK now, if this read freed lots of space
+	 * in our buffer. Certainly, new_window is new window.
+	 * We can advertise it now, if it is not less than
+	 * current one.
+	 * "Lots" means "at least twice" here.
+	 */
+	if (!new_window || new_window < 2 * rcv_window_now)
+		return;
+
+	/* Otherwise, one of the ACKs above already announced it */
+	if (!acked) {
+		tcp_send_ack(sk);
+		NET_INC_STATS_USER(sock_net(meta_sk), LINUX_MIB_MPTCPWINUPDATE);
+		cnt_wnd--;
+	}
+
+	if (cnt_wnd)
+		NET_ADD_STATS_USER(sock_net(meta_sk),
+				   LINUX_MIB_MPTCPWINUPDATESAVED, cnt_wnd);
 }
 
 static int mptcp_sub_send_fin(struct sock *sk)
@@ -1262,6 +1384,65 @@ void mptcp_update_sndbuf(struct mptcp_cb *mpcb)
 	meta_sk->sk_sndbuf = max(min(new_sndbuf, sysctl_tcp_wmem[2]), meta_sk->sk_sndbuf);
 }
 
+/* Connection-level state for TCP_MULTIPATH_INFO and INET_DIAG_MPTCPINFO.
+ * Like tcp_get_info, this may be called without holding the socket-lock.
+ */
+void mptcp_get_meta_info(const struct sock *meta_sk,
+			 struct mptcp_meta_info *info)
+{
+	const struct tcp_sock *meta_tp = tcp_sk(meta_sk);
+	const struct mptcp_cb *mpcb = meta_tp->mpcb;
+
+	memset(info, 0, sizeof(*info));
+
+	info->mptcpi_loc_token = mpcb->mptcp_loc_token;
+	info->mptcpi_rem_token = mpcb->mptcp_rem_token;
+	info->mptcpi_subflows = mpcb->cnt_subflows;
+	info->mptcpi_established = mpcb->cnt_established;
+	info->mptcpi_dss_csum = mpcb->dss_csum;
+	info->mptcpi_infinite = mpcb->infinite_mapping_snd ||
+				mpcb->infinite_mapping_rcv;
+
+	info->mptcpi_ofo_queue = skb_queue_len(&meta_tp->out_of_order_queue);
+	info->mptcpi_reinject_queue = skb_queue_len(&mpcb->reinject_queue);
+	info->mptcpi_snd_wnd = meta_tp->snd_wnd;
+	info->mptcpi_rcv_wnd = meta_tp->rcv_wnd;
+	info->mptcpi_unacked = meta_tp->write_seq - meta_tp->snd_una;
+}
+
+void mptcp_get_sub_info(const struct sock *sk, struct mptcp_sub_info *info)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+
+	memset(info, 0, sizeof(*info));
+
+	info->mptcpi_path_index = tp->mptcp->path_index;
+	info->mptcpi_state = sk->sk_state;
+	info->mptcpi_low_prio = tp->mptcp->low_prio;
+	info->mptcpi_rcv_low_prio = tp->mptcp->rcv_low_prio;
+
+	info->mptcpi_rtt = jiffies_to_usecs(tp->srtt) >> 3;
+	info->mptcpi_rttvar = jiffies_to_usecs(tp->mdev) >> 2;
+	info->mptcpi_snd_cwnd = tp->snd_cwnd;
+	info->mptcpi_snd_ssthresh = tp->snd_ssthresh;
+	info->mptcpi_unacked = tp->packets_out;
+	info->mptcpi_retrans = tp->retrans_out;
+
+	info->mptcpi_bytes_sched = tp->mptcp->bytes_sched;
+	info->mptcpi_bytes_reinj = tp->mptcp->bytes_reinj;
+}
+
+/* inet_diag dumps the subflows, as they are the ones in the established
+ * hash-table. The connection-level state is reported along with each of
+ * them, user-space can group them by token.
+ */
+void mptcp_get_diag_info(const struct sock *sk, struct mptcp_diag_info *info)
+{
+	mptcp_get_meta_info(mptcp_meta_sk(sk), &info->meta);
+	mptcp_get_sub_info(sk, &info->sub);
+}
+EXPORT_SYMBOL_GPL(mptcp_get_diag_info);
+
 void mptcp_close(struct sock *meta_sk, long timeout)
 {
 	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
@@ -1536,8 +1717,11 @@ int mptcp_check_req_master(struct sock *sk, struct sock *child,
 	 /* Hold when creating the meta-sk in tcp_vX_syn_recv_sock. */
 	sock_put(meta_sk);
 
-	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
+	/* A syncookie-request (prev == NULL) never was in the SYN-queue */
+	if (prev) {
+		inet_csk_reqsk_queue_unlink(sk, req, prev);
+		inet_csk_reqsk_queue_removed(sk, req);
+	}
 	inet_csk_reqsk_queue_add(sk, req, meta_sk);
 
 	return 0;
@@ -1558,8 +1742,7 @@ struct sock *mptcp_check_req_child(struct sock *meta_sk, struct sock *child,
 	if (!mopt->join_ack)
 		goto teardown;
 
-	mptcp_hmac_sha1((u8 *)&mpcb->mptcp_rem_key,
-			(u8 *)&mpcb->mptcp_loc_key,
+	mptcp_hmac_sha1(&mpcb->hmac_rem,
 			(u8 *)&mtreq->mptcp_rem_nonce,
 			(u8 *)&mtreq->mptcp_loc_nonce,
 			(u32 *)hash_mac_check);
@@ -1649,6 +1832,8 @@ void __init mptcp_init(void)
 	if (mptcp_pm_init())
 		goto mptcp_pm_failed;
 
+	mptcp_sched_init();
+
 #ifdef CONFIG_SYSCTL
 	mptcp_sysctl = register_net_sysctl_table(&init_net, path, mptcp_table);
 	if (!mptcp_sysctl)
@@ -0,0 +1,461 @@
+/*
+ *	MPTCP implementation - Generic netlink path-manager
+ *
+ *	Reports the connections, their subflows and the addresses announced by
+ *	the peer to userspace, and lets a daemon drive the path-management of
+ *	a connection with batches of operations (see linux/mptcp_genl.h).
+ *
+ *	With sysctl mptcp_pm_netlink set, the kernel neither announces the
+ *	local addresses, nor establishes the full-mesh of subflows on its own.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mptcp_genl.h>
+#include <linux/netdevice.h>
+
+#include <net/genetlink.h>
+#include <net/mptcp.h>
+#include <net/mptcp_v4.h>
+#include <net/mptcp_v6.h>
+
+static struct genl_family mptcp_genl_family = {
+	.id		= GENL_ID_GENERATE,
+	.name		= MPTCP_GENL_NAME,
+	.version	= MPTCP_GENL_VERSION,
+	.maxattr	= MPTCP_ATTR_MAX,
+	.netnsok	= true,
+};
+
+static struct genl_multicast_group mptcp_genl_ev_grp = {
+	.name		= MPTCP_GENL_EV_GRP_NAME,
+};
+
+static const struct nla_policy mptcp_genl_policy[MPTCP_ATTR_MAX + 1] = {
+	[MPTCP_ATTR_TOKEN]	= { .type = NLA_U32, },
+	[MPTCP_ATTR_OP]		= { .type = NLA_NESTED, },
+	[MPTCP_ATTR_OP_TYPE]	= { .type = NLA_U8, },
+	[MPTCP_ATTR_FAMILY]	= { .type = NLA_U16, },
+	[MPTCP_ATTR_LOC_ADDR]	= { .type = NLA_BINARY,
+				    .len = sizeof(struct in6_addr), },
+	[MPTCP_ATTR_REM_ADDR]	= { .type = NLA_BINARY,
+				    .len = sizeof(struct in6_addr), },
+	[MPTCP_ATTR_LOC_PORT]	= { .type = NLA_U16, },
+	[MPTCP_ATTR_REM_PORT]	= { .type = NLA_U16, },
+	[MPTCP_ATTR_LOC_ID]	= { .type = NLA_U8, },
+	[MPTCP_ATTR_REM_ID]	= { .type = NLA_U8, },
+	[MPTCP_ATTR_PATH_INDEX]	= { .type = NLA_U8, },
+	[MPTCP_ATTR_BACKUP]	= { .type = NLA_U8, },
+};
+
+/****** Events ******/
+
+/* Returns NULL if nobody listens to the events in this netns */
+static struct sk_buff *mptcp_genl_event_new(struct net *net,
+					    const struct mptcp_cb *mpcb,
+					    u8 cmd, void **hdr)
+{
+	struct sk_buff *msg;
+
+	if (!netlink_has_listeners(net->genl_sock, mptcp_genl_ev_grp.id))
+		return NULL;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_ATOMIC);
+	if (!msg)
+		return NULL;
+
+	*hdr = genlmsg_put(msg, 0, 0, &mptcp_genl_family, 0, cmd);
+	if (!*hdr)
+		goto nla_put_failure;
+
+	NLA_PUT_U32(msg, MPTCP_ATTR_TOKEN, mpcb->mptcp_loc_token);
+
+	return msg;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return NULL;
+}
+
+static void mptcp_genl_event_send(struct net *net, struct sk_buff *msg,
+				  void *hdr)
+{
+	genlmsg_end(msg, hdr);
+	genlmsg_multicast_netns(net, msg, 0, mptcp_genl_ev_grp.id, GFP_ATOMIC);
+}
+
+static int mptcp_genl_put_addrs(struct sk_buff *msg, struct sock *sk)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+
+	if (sk->sk_family == AF_INET || mptcp_v6_is_v4_mapped(sk)) {
+		NLA_PUT_U16(msg, MPTCP_ATTR_FAMILY, AF_INET);
+		NLA_PUT_BE32(msg, MPTCP_ATTR_LOC_ADDR, inet->inet_saddr);
+		NLA_PUT_BE32(msg, MPTCP_ATTR_REM_ADDR, inet->inet_daddr);
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	} else {
+		NLA_PUT_U16(msg, MPTCP_ATTR_FAMILY, AF_INET6);
+		NLA_PUT(msg, MPTCP_ATTR_LOC_ADDR, sizeof(struct in6_addr),
+			&inet6_sk(sk)->saddr);
+		NLA_PUT(msg, MPTCP_ATTR_REM_ADDR, sizeof(struct in6_addr),
+			&inet6_sk(sk)->daddr);
+#endif
+	}
+	NLA_PUT_BE16(msg, MPTCP_ATTR_LOC_PORT, inet->inet_sport);
+	NLA_PUT_BE16(msg, MPTCP_ATTR_REM_PORT, inet->inet_dport);
+
+	return 0;
+
+nla_put_failure:
+	return -EMSGSIZE;
+}
+
+/* MPTCP_EVENT_CREATED/CLOSED */
+void mptcp_genl_conn_event(struct sock *meta_sk, u8 cmd)
+{
+	struct net *net = sock_net(meta_sk);
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = mptcp_genl_event_new(net, tcp_sk(meta_sk)->mpcb, cmd, &hdr);
+	if (!msg)
+		return;
+
+	if (mptcp_genl_put_addrs(msg, meta_sk))
+		goto nla_put_failure;
+
+	mptcp_genl_event_send(net, msg, hdr);
+	return;
+
+nla_put_failure:
+	nlmsg_free(msg);
+}
+
+/* MPTCP_EVENT_SUB_ESTABLISHED/CLOSED */
+void mptcp_genl_sub_event(struct sock *sk, u8 cmd)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct net *net = sock_net(sk);
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = mptcp_genl_event_new(net, tp->mpcb, cmd, &hdr);
+	if (!msg)
+		return;
+
+	if (mptcp_genl_put_addrs(msg, sk))
+		goto nla_put_failure;
+
+	NLA_PUT_U8(msg, MPTCP_ATTR_PATH_INDEX, tp->mptcp->path_index);
+	NLA_PUT_U8(msg, MPTCP_ATTR_REM_ID, tp->mptcp->rem_id);
+	NLA_PUT_U8(msg, MPTCP_ATTR_BACKUP, tp->mptcp->low_prio);
+
+	mptcp_genl_event_send(net, msg, hdr);
+	return;
+
+nla_put_failure:
+	nlmsg_free(msg);
+}
+
+/* MPTCP_EVENT_ANNOUNCED/REMOVED. addr is NULL for MPTCP_EVENT_REMOVED, as
+ * REMOVE_ADDR only carries the address-id.
+ */
+void mptcp_genl_addr_event(const struct mptcp_cb *mpcb, u8 cmd,
+			   sa_family_t family, const void *addr, __be16 port,
+			   u8 id)
+{
+	struct net *net = sock_net(mpcb->meta_sk);
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = mptcp_genl_event_new(net, mpcb, cmd, &hdr);
+	if (!msg)
+		return;
+
+	NLA_PUT_U8(msg, MPTCP_ATTR_REM_ID, id);
+	if (addr) {
+		NLA_PUT_U16(msg, MPTCP_ATTR_FAMILY, family);
+		NLA_PUT(msg, MPTCP_ATTR_REM_ADDR, family == AF_INET ?
+			sizeof(struct in_addr) : sizeof(struct in6_addr), addr);
+		NLA_PUT_BE16(msg, MPTCP_ATTR_REM_PORT, port);
+	}
+
+	mptcp_genl_event_send(net, msg, hdr);
+	return;
+
+nla_put_failure:
+	nlmsg_free(msg);
+}
+
+/****** Commands ******/
+
+static struct sock *mptcp_genl_find_sub(const struct mptcp_cb *mpcb,
+					struct nlattr **tb)
+{
+	struct sock *sk;
+	u8 pi;
+
+	if (!tb[MPTCP_ATTR_PATH_INDEX])
+		return NULL;
+
+	pi = nla_get_u8(tb[MPTCP_ATTR_PATH_INDEX]);
+	mptcp_for_each_sk(mpcb, sk) {
+		if (tcp_sk(sk)->mptcp->path_index == pi)
+			return sk;
+	}
+
+	return NULL;
+}
+
+/* Announcing and withdrawing an address is handled like the corresponding
+ * address-event, but only for this connection.
+ */
+static int mptcp_genl_op_addr(struct mptcp_cb *mpcb, struct nlattr **tb,
+			      u8 op)
+{
+	struct mptcp_addr_event event;
+	int len;
+
+	if (!tb[MPTCP_ATTR_FAMILY] || !tb[MPTCP_ATTR_LOC_ADDR])
+		return -EINVAL;
+
+	memset(&event, 0, sizeof(event));
+	event.family = nla_get_u16(tb[MPTCP_ATTR_FAMILY]);
+	len = nla_len(tb[MPTCP_ATTR_LOC_ADDR]);
+
+	if (event.family == AF_INET) {
+		if (len != sizeof(struct in_addr))
+			return -EINVAL;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	} else if (event.family == AF_INET6) {
+		if (len != sizeof(struct in6_addr))
+			return -EINVAL;
+#endif
+	} else {
+		return -EAFNOSUPPORT;
+	}
+	nla_memcpy(&event.addr, tb[MPTCP_ATTR_LOC_ADDR], len);
+
+	/* NETDEV_CHANGE adds the address if it is not yet known and
+	 * otherwise updates the priority of its subflows.
+	 */
+	event.code = op == MPTCP_OP_ANNOUNCE ? NETDEV_CHANGE : NETDEV_DOWN;
+	event.if_running = 1;
+	if (tb[MPTCP_ATTR_BACKUP])
+		event.low_prio = !!nla_get_u8(tb[MPTCP_ATTR_BACKUP]);
+
+	local_bh_disable();
+	mptcp_pm_apply_event(&event, mpcb);
+	local_bh_enable();
+
+	return 0;
+}
+
+static int mptcp_genl_op_sub_create(struct sock *meta_sk, struct nlattr **tb)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	u8 loc_id, rem_id;
+	int i, j;
+
+	if (!tb[MPTCP_ATTR_FAMILY] || !tb[MPTCP_ATTR_LOC_ID] ||
+	    !tb[MPTCP_ATTR_REM_ID])
+		return -EINVAL;
+
+	/* The keys are needed for the MP_JOIN */
+	if (mpcb->master_sk &&
+	    !tcp_sk(mpcb->master_sk)->mptcp->fully_established)
+		return -EAGAIN;
+
+	loc_id = nla_get_u8(tb[MPTCP_ATTR_LOC_ID]);
+	rem_id = nla_get_u8(tb[MPTCP_ATTR_REM_ID]);
+
+	switch (nla_get_u16(tb[MPTCP_ATTR_FAMILY])) {
+	case AF_INET:
+		mptcp_for_each_bit_set(mpcb->loc4_bits, i) {
+			if (mpcb->locaddr4[i].id != loc_id)
+				continue;
+
+			mptcp_for_each_bit_set(mpcb->rem4_bits, j) {
+				if (mpcb->remaddr4[j].id != rem_id)
+					continue;
+
+				return mptcp_init4_subsockets(meta_sk,
+							      &mpcb->locaddr4[i],
+							      &mpcb->remaddr4[j]);
+			}
+		}
+		return -EADDRNOTAVAIL;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	case AF_INET6:
+		mptcp_for_each_bit_set(mpcb->loc6_bits, i) {
+			if (mpcb->locaddr6[i].id != loc_id)
+				continue;
+
+			mptcp_for_each_bit_set(mpcb->rem6_bits, j) {
+				if (mpcb->remaddr6[j].id != rem_id)
+					continue;
+
+				return mptcp_init6_subsockets(meta_sk,
+							      &mpcb->locaddr6[i],
+							      &mpcb->remaddr6[j]);
+			}
+		}
+		return -EADDRNOTAVAIL;
+#endif
+	}
+
+	return -EAFNOSUPPORT;
+}
+
+static int mptcp_genl_op_sub_destroy(struct mptcp_cb *mpcb, struct nlattr **tb)
+{
+	struct sock *sk = mptcp_genl_find_sub(mpcb, tb);
+
+	if (!sk)
+		return -ENOENT;
+
+	local_bh_disable();
+	mptcp_reinject_data(sk, 0);
+	mptcp_sub_force_close(sk);
+	local_bh_enable();
+
+	return 0;
+}
+
+static int mptcp_genl_op_sub_priority(struct mptcp_cb *mpcb,
+				      struct nlattr **tb)
+{
+	struct sock *sk = mptcp_genl_find_sub(mpcb, tb);
+	struct tcp_sock *tp;
+	u8 low_prio;
+
+	if (!sk)
+		return -ENOENT;
+	if (!tb[MPTCP_ATTR_BACKUP])
+		return -EINVAL;
+
+	tp = tcp_sk(sk);
+	low_prio = !!nla_get_u8(tb[MPTCP_ATTR_BACKUP]);
+	if (low_prio == tp->mptcp->low_prio)
+		return 0;
+
+	tp->mptcp->low_prio = low_prio;
+	tp->mptcp->send_mp_prio = 1;
+
+	/* Don't wait for the next segment to send the MP_PRIO */
+	if (sk->sk_state == TCP_ESTABLISHED) {
+		local_bh_disable();
+		tcp_send_ack(sk);
+		local_bh_enable();
+	}
+
+	return 0;
+}
+
+static int mptcp_genl_do_op(struct sock *meta_sk, struct nlattr **tb)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	u8 op;
+
+	if (!tb[MPTCP_ATTR_OP_TYPE])
+		return -EINVAL;
+
+	op = nla_get_u8(tb[MPTCP_ATTR_OP_TYPE]);
+	switch (op) {
+	case MPTCP_OP_ANNOUNCE:
+	case MPTCP_OP_WITHDRAW:
+		return mptcp_genl_op_addr(mpcb, tb, op);
+	case MPTCP_OP_SUB_CREATE:
+		return mptcp_genl_op_sub_create(meta_sk, tb);
+	case MPTCP_OP_SUB_DESTROY:
+		return mptcp_genl_op_sub_destroy(mpcb, tb);
+	case MPTCP_OP_SUB_PRIORITY:
+		return mptcp_genl_op_sub_priority(mpcb, tb);
+	}
+
+	return -EOPNOTSUPP;
+}
+
+/* All the operations of the batch are done while holding the locks of the
+ * connection once, like mptcp_create_subflow_worker does.
+ */
+static int mptcp_genl_exec(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *tb[MPTCP_ATTR_MAX + 1];
+	struct sock *meta_sk;
+	struct mptcp_cb *mpcb;
+	struct nlattr *nla;
+	int rem, err = 0;
+
+	if (!info->attrs[MPTCP_ATTR_TOKEN])
+		return -EINVAL;
+
+	meta_sk = mptcp_hash_find(genl_info_net(info),
+				  nla_get_u32(info->attrs[MPTCP_ATTR_TOKEN]));
+	if (!meta_sk)
+		return -ENOENT;
+	mpcb = tcp_sk(meta_sk)->mpcb;
+
+	mutex_lock(&mpcb->mutex);
+	lock_sock_nested(meta_sk, SINGLE_DEPTH_NESTING);
+
+	if (sock_flag(meta_sk, SOCK_DEAD) || !tcp_sk(meta_sk)->mpc ||
+	    mpcb->infinite_mapping_snd || mpcb->infinite_mapping_rcv) {
+		err = -ENOTCONN;
+		goto exit;
+	}
+
+	nlmsg_for_each_attr(nla, info->nlhdr, GENL_HDRLEN, rem) {
+		if (nla_type(nla) != MPTCP_ATTR_OP)
+			continue;
+
+		err = nla_parse_nested(tb, MPTCP_ATTR_MAX, nla,
+				       mptcp_genl_policy);
+		if (!err)
+			err = mptcp_genl_do_op(meta_sk, tb);
+		if (err) {
+			mptcp_debug("%s: token %#x op failed: %d\n", __func__,
+				    mpcb->mptcp_loc_token, err);
+			break;
+		}
+	}
+
+exit:
+	release_sock(meta_sk);
+	mutex_unlock(&mpcb->mutex);
+	sock_put(meta_sk); /* Taken by mptcp_hash_find */
+	return err;
+}
+
+static struct genl_ops mptcp_genl_ops[] = {
+	{
+		.cmd	= MPTCP_CMD_EXEC,
+		.doit	= mptcp_genl_exec,
+		.policy	= mptcp_genl_policy,
+		.flags	= GENL_ADMIN_PERM,
+	},
+};
+
+int __init mptcp_genl_init(void)
+{
+	int ret;
+
+	ret = genl_register_family_with_ops(&mptcp_genl_family, mptcp_genl_ops,
+					    ARRAY_SIZE(mptcp_genl_ops));
+	if (ret)
+		return ret;
+
+	ret = genl_register_mc_group(&mptcp_genl_family, &mptcp_genl_ev_grp);
+	if (ret)
+		genl_unregister_family(&mptcp_genl_family);
+
+	return ret;
+}
+
+void mptcp_genl_undo(void)
+{
+	genl_unregister_family(&mptcp_genl_family);
+}
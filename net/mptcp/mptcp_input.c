@@ -29,10 +29,14 @@
 
 #include <asm/unaligned.h>
 
+#include <linux/mptcp_genl.h>
+
 #include <net/mptcp.h>
 #include <net/mptcp_v4.h>
 #include <net/mptcp_v6.h>
 
+#include <trace/events/mptcp.h>
+
 static inline void mptcp_become_fully_estab(struct sock *sk)
 {
 	tcp_sk(sk)->mptcp->fully_established = 1;
@@ -41,6 +45,31 @@ static inline void mptcp_become_fully_estab(struct sock *sk)
 		mptcp_create_subflows(mptcp_meta_sk(sk));
 }
 
+/* Estimates the time from the first transmission of a segment at the
+ * meta-level, until it gets DATA_ACKed. Contrary to the subflows' srtt, this
+ * includes the time the segment is held back in the peer's meta out-of-order
+ * queue. Same algorithm as tcp_rtt_estimator.
+ */
+static void mptcp_rtt_estimator(struct tcp_sock *meta_tp, long mrtt)
+{
+	long m = mrtt;
+
+	if (m == 0)
+		m = 1;
+
+	if (meta_tp->srtt != 0) {
+		m -= (meta_tp->srtt >> 3);	/* m is now error in rtt est */
+		meta_tp->srtt += m;		/* rtt = 7/8 rtt + 1/8 new */
+		if (m < 0)
+			m = -m;			/* m is now abs(error) */
+		m -= (meta_tp->mdev >> 2);	/* similar update on mdev */
+		meta_tp->mdev += m;		/* mdev = 3/4 mdev + 1/4 new */
+	} else {
+		meta_tp->srtt = m << 3;
+		meta_tp->mdev = m << 1;
+	}
+}
+
 /**
  * Cleans the meta-socket retransmission queue and the reinject-queue.
  * @sk must be the metasocket.
@@ -50,7 +79,8 @@ static void mptcp_clean_rtx_queue(struct sock *meta_sk, u32 prior_snd_una)
 	struct sk_buff *skb, *tmp;
 	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
 	struct mptcp_cb *mpcb = meta_tp->mpcb;
-	int acked = 0;
+	int acked = 0, retrans_acked = 0;
+	long seq_rtt = -1;
 
 	while ((skb = tcp_write_queue_head(meta_sk)) &&
 	       skb != tcp_send_head(meta_sk)) {
@@ -80,11 +110,23 @@ static void mptcp_clean_rtx_queue(struct sock *meta_sk, u32 prior_snd_una)
 			}
 		}
 
+		/* The most recently sent of the acked segments has been
+		 * the least delayed by the cumulative DATA_ACK. Karn's rule:
+		 * no sample if one of them has been sent more than once.
+		 */
+		if (TCP_SKB_CB(skb)->sacked & TCPCB_EVER_RETRANS)
+			retrans_acked = 1;
+		else if (TCP_SKB_CB(skb)->when)
+			seq_rtt = tcp_time_stamp - TCP_SKB_CB(skb)->when;
+
 		meta_tp->packets_out -= tcp_skb_pcount(skb);
 		sk_wmem_free_skb(meta_sk, skb);
 
 		acked = 1;
 	}
+
+	if (seq_rtt >= 0 && !retrans_acked)
+		mptcp_rtt_estimator(meta_tp, seq_rtt);
 	/* Remove acknowledged data from the reinject queue */
 	skb_queue_walk_safe(&mpcb->reinject_queue, skb, tmp) {
 		if (before(meta_tp->snd_una, TCP_SKB_CB(skb)->end_seq))
@@ -200,6 +242,21 @@ static int mptcp_rcv_state_process(struct sock *meta_sk, struct sock *sk,
 	return 0;
 }
 
+/* Checksum of the first len bytes of the payload. If TCP already summed the
+ * whole segment, we only have to remove the TCP-header from its checksum.
+ */
+static __wsum mptcp_skb_csum(const struct sk_buff *skb, unsigned int len)
+{
+	int hdrlen = skb->data - skb_transport_header(skb);
+
+	if ((TCP_SKB_CB(skb)->mptcp_flags & MPTCPHDR_CSUM_SEG) &&
+	    len == skb->len && hdrlen == tcp_hdrlen(skb))
+		return csum_sub(skb->csum,
+				csum_partial(skb_transport_header(skb), hdrlen, 0));
+
+	return skb_checksum(skb, 0, len, 0);
+}
+
 /**
  * @return:
  *  i) 1: Everything's fine.
@@ -213,8 +270,8 @@ static int mptcp_verif_dss_csum(struct sock *sk)
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct sk_buff *tmp, *tmp1, *last = NULL;
 	__wsum csum_tcp = 0; /* cumulative checksum of pld + mptcp-header */
-	int ans = 1, overflowed = 0, offset = 0, dss_csum_added = 0;
-	int iter = 0;
+	int ans = 1, dss_csum_added = 0;
+	int iter = 0, pos = 0;
 
 	skb_queue_walk_safe(&sk->sk_receive_queue, tmp, tmp1) {
 		unsigned int csum_len;
@@ -227,26 +284,12 @@ static int mptcp_verif_dss_csum(struct sock *sk)
 		else
 			csum_len = tmp->len;
 
-		offset = 0;
-		if (overflowed) {
-			char first_word[4];
-			first_word[0] = 0;
-			first_word[1] = 0;
-			first_word[2] = 0;
-			first_word[3] = *(tmp->data);
-			csum_tcp = csum_partial(first_word, 4, csum_tcp);
-			offset = 1;
-			csum_len--;
-			overflowed = 0;
-		}
-
-		csum_tcp = skb_checksum(tmp, offset, csum_len, csum_tcp);
-
-		/* Was it on an odd-length? Then we have to merge the next byte
-		 * correctly (see above)
+		/* csum_block_add takes care of segments starting at an odd
+		 * offset of the mapping.
 		 */
-		if (csum_len != (csum_len & (~1)))
-			overflowed = 1;
+		csum_tcp = csum_block_add(csum_tcp, mptcp_skb_csum(tmp, csum_len),
+					  pos);
+		pos += csum_len;
 
 		if (mptcp_is_data_seq(tmp) && !dss_csum_added) {
 			__be32 data_seq = htonl((u32)(tp->mptcp->map_data_seq >> 32));
@@ -280,9 +323,9 @@ static int mptcp_verif_dss_csum(struct sock *sk)
 
 	/* Now, checksum must be 0 */
 	if (unlikely(csum_fold(csum_tcp))) {
-		pr_err("%s csum is wrong: %#x data_seq %u dss_csum_added %d overflowed %d iterations %d\n",
+		pr_err("%s csum is wrong: %#x data_seq %u dss_csum_added %d len %d iterations %d\n",
 			    __func__, csum_fold(csum_tcp),
-			    TCP_SKB_CB(last)->seq, dss_csum_added, overflowed,
+			    TCP_SKB_CB(last)->seq, dss_csum_added, pos,
 			    iter);
 
 		tp->mptcp->send_mp_fail = 1;
@@ -394,6 +437,7 @@ static void mptcp_skb_trim_head(struct sk_buff *skb, struct sock *sk, u32 seq)
 		__pskb_trim_head(skb, len - skb_headlen(skb));
 
 	TCP_SKB_CB(skb)->seq = htonl(new_seq);
+	TCP_SKB_CB(skb)->mptcp_flags &= ~MPTCPHDR_CSUM_SEG;
 
 	skb->truesize -= len;
 	atomic_sub(len, &sk->sk_rmem_alloc);
@@ -427,6 +471,7 @@ static int mptcp_skb_split_tail(struct sk_buff *skb, struct sock *sk, u32 seq)
 
 	tcp_hdr(buff)->fin = tcp_hdr(skb)->fin;
 	tcp_hdr(skb)->fin = 0;
+	TCP_SKB_CB(skb)->mptcp_flags &= ~MPTCPHDR_CSUM_SEG;
 
 	/* We absolutly need to call skb_set_owner_r before refreshing the
 	 * truesize of buff, otherwise the moved data will account twice.
@@ -673,6 +718,8 @@ static int mptcp_detect_mapping(struct sock *sk, struct sk_buff *skb)
 	tp->mptcp->map_data_fin = mptcp_is_data_fin(skb) ? 1 : 0;
 	tp->mptcp->mapping_present = 1;
 
+	trace_mptcp_mapping(sk);
+
 	return 0;
 }
 
@@ -754,6 +801,97 @@ static int mptcp_validate_mapping(struct sock *sk, struct sk_buff *skb)
 	return 0;
 }
 
+/* Put skb, starting at the meta's rcv_nxt, in the meta-receive-queue - or
+ * copy it directly to the application.
+ *
+ * @return: 1 if the segment has been eaten by the application.
+ */
+static int mptcp_rcv_in_order(struct sock *meta_sk, struct sk_buff *skb,
+			      struct tcp_sock *tp)
+{
+	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
+	int eaten = 0;
+
+	/* Is direct copy possible ? */
+	if (TCP_SKB_CB(skb)->seq == meta_tp->rcv_nxt &&
+	    meta_tp->ucopy.task == current &&
+	    meta_tp->copied_seq == meta_tp->rcv_nxt &&
+	    meta_tp->ucopy.len &&
+	    sock_owned_by_user(meta_sk))
+		eaten = mptcp_direct_copy(skb, tp, meta_sk);
+
+	if (!eaten) {
+		__skb_queue_tail(&meta_sk->sk_receive_queue, skb);
+		skb_set_owner_r(skb, meta_sk);
+	}
+	mptcp_check_rcvseq_wrap(meta_tp,
+				TCP_SKB_CB(skb)->end_seq - meta_tp->rcv_nxt);
+	meta_tp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+
+	if (tcp_hdr(skb)->fin)
+		mptcp_fin(meta_sk);
+
+	/* Check if this fills a gap in the ofo queue */
+	if (!skb_queue_empty(&meta_tp->out_of_order_queue))
+		mptcp_ofo_queue(meta_sk);
+
+	if (eaten)
+		__kfree_skb(skb);
+
+	return eaten;
+}
+
+/* Fast path of a connection with a single subflow and without
+ * DSS-checksum.
+ *
+ * mptcp_queue_skb() waits for the whole mapping before passing it to the
+ * meta, as the checksum covers the complete mapping. Without checksum this
+ * is not needed: the head of the subflow's receive-queue goes right away to
+ * the meta-receive-queue (or to the application), if it is the next
+ * in-order data at the meta-level. With TSO-sized mappings this avoids
+ * holding up to 64KB in the subflow.
+ *
+ * The last segment of the mapping (it may hold the DATA_FIN) and anything
+ * unusual is left to mptcp_queue_skb(). Once a second subflow has joined,
+ * all segments take again the full path.
+ *
+ * @return: 0  not applicable, use mptcp_queue_skb()
+ *	    -1 skb has been put in the meta-receive-queue
+ *	    -2 skb has been eaten by the application
+ */
+static int mptcp_fast_queue_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk), *meta_tp = mptcp_meta_tp(tp);
+	struct sock *meta_sk = mptcp_meta_sk(sk);
+	struct mptcp_cb *mpcb = tp->mpcb;
+	struct tcp_skb_cb *tcb = TCP_SKB_CB(skb);
+	u32 offset = tcb->seq - tp->mptcp->map_subseq;
+
+	if (mpcb->cnt_subflows != 1 || mpcb->dss_csum ||
+	    mpcb->infinite_mapping_rcv || !tp->mptcp->mapping_present ||
+	    tp->mptcp->send_mp_fail)
+		return 0;
+
+	if (skb != skb_peek(&sk->sk_receive_queue) || !skb->len ||
+	    tcp_hdr(skb)->fin || before(tcb->seq, tp->mptcp->map_subseq) ||
+	    !before(tcb->end_seq, tp->mptcp->map_subseq + tp->mptcp->map_data_len))
+		return 0;
+
+	if (tp->mptcp->map_data_seq + offset != mptcp_get_rcv_nxt_64(meta_tp))
+		return 0;
+
+	tp->copied_seq = tcb->end_seq;
+	__skb_unlink(skb, &sk->sk_receive_queue);
+
+	tcb->seq = meta_tp->rcv_nxt;
+	tcb->end_seq = tcb->seq + skb->len;
+
+	NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_MPTCPFASTPATHRCV);
+	inet_csk(meta_sk)->icsk_ack.lrcvtime = tcp_time_stamp;
+
+	return mptcp_rcv_in_order(meta_sk, skb, tp) ? -2 : -1;
+}
+
 /* @return: 0  everything is fine. Just continue processing
  *	    1  subflow is broken stop everything
  *	    -1 this mapping has been put in the meta-receive-queue
@@ -831,8 +969,6 @@ static int mptcp_queue_skb(struct sock *sk)
 	} else {
 		/* Ready for the meta-rcv-queue */
 		skb_queue_walk_safe(&sk->sk_receive_queue, tmp1, tmp) {
-			int eaten = 0;
-
 			tp->copied_seq = TCP_SKB_CB(tmp1)->end_seq;
 			mptcp_prepare_skb(tmp1, tmp, sk);
 			__skb_unlink(tmp1, &sk->sk_receive_queue);
@@ -843,33 +979,7 @@ static int mptcp_queue_skb(struct sock *sk)
 				goto next;
 			}
 
-			/* Is direct copy possible ? */
-			if (TCP_SKB_CB(tmp1)->seq == meta_tp->rcv_nxt &&
-			    meta_tp->ucopy.task == current &&
-			    meta_tp->copied_seq == meta_tp->rcv_nxt &&
-			    meta_tp->ucopy.len &&
-			    sock_owned_by_user(meta_sk))
-				eaten = mptcp_direct_copy(tmp1, tp, meta_sk);
-
-			if (!eaten) {
-				__skb_queue_tail(&meta_sk->sk_receive_queue, tmp1);
-				skb_set_owner_r(tmp1, meta_sk);
-			}
-			mptcp_check_rcvseq_wrap(meta_tp,
-						TCP_SKB_CB(tmp1)->end_seq -
-						meta_tp->rcv_nxt);
-			meta_tp->rcv_nxt = TCP_SKB_CB(tmp1)->end_seq;
-
-			if (tcp_hdr(tmp1)->fin)
-				mptcp_fin(meta_sk);
-
-			/* Check if this fills a gap in the ofo queue */
-			if (!skb_queue_empty(&meta_tp->out_of_order_queue))
-				mptcp_ofo_queue(meta_sk);
-
-			if (eaten)
-				__kfree_skb(tmp1);
-
+			mptcp_rcv_in_order(meta_sk, tmp1, tp);
 			data_queued = true;
 next:
 			if (!skb_queue_empty(&sk->sk_receive_queue) &&
@@ -924,7 +1034,9 @@ restart:
 			goto restart;
 
 		/* Push a level higher */
-		ret = mptcp_queue_skb(sk);
+		ret = mptcp_fast_queue_skb(sk, skb);
+		if (!ret)
+			ret = mptcp_queue_skb(sk);
 		if (ret < 0) {
 			if (ret == -1)
 				queued = ret;
@@ -1051,7 +1163,7 @@ static void mptcp_data_ack(struct sock *sk, const struct sk_buff *skb)
 	 */
 	if (tp->mptcp->pre_established && !tcp_hdr(skb)->syn) {
 		tp->mptcp->pre_established = 0;
-		sk_stop_timer(sk, &tp->mptcp->mptcp_ack_timer);
+		sk_stop_timer(sk, tp->mptcp->mptcp_ack_timer);
 	}
 
 	/* If we are in infinite mapping mode, rx_opt.data_ack has been
@@ -1274,6 +1386,8 @@ void mptcp_parse_options(const uint8_t *ptr, int opsize,
 
 		if (opsize >= MPTCP_SUB_LEN_CAPABLE_SYN)
 			mopt->mptcp_rem_key = mpcapable->sender_key;
+		if (opsize == MPTCP_SUB_LEN_CAPABLE_ACK)
+			mopt->mptcp_echo_key = mpcapable->receiver_key;
 
 		break;
 	}
@@ -1463,26 +1577,211 @@ void mptcp_parse_options(const uint8_t *ptr, int opsize,
 	}
 }
 
-int mptcp_check_rtt(const struct tcp_sock *tp, int time)
+/* Returns the offset of the DSS-option within the TCP-header, 0 if there is
+ * none.
+ */
+static int mptcp_gro_dss_off(const struct tcphdr *th)
 {
-	struct mptcp_cb *mpcb = tp->mpcb;
+	const unsigned char *ptr = (const unsigned char *)(th + 1);
+	int length = th->doff * 4 - sizeof(*th);
+
+	while (length > 0) {
+		int opcode = *ptr++;
+		int opsize;
+
+		switch (opcode) {
+		case TCPOPT_EOL:
+			return 0;
+		case TCPOPT_NOP:
+			length--;
+			continue;
+		default:
+			if (length < 2)
+				return 0;
+			opsize = *ptr;
+			if (opsize < 2 || opsize > length)
+				return 0;
+			if (opcode == TCPOPT_MPTCP &&
+			    opsize >= MPTCP_SUB_LEN_DSS &&
+			    ((struct mptcp_option *)(ptr - 1))->sub == MPTCP_SUB_DSS)
+				return ptr - 1 - (const unsigned char *)th;
+			ptr += opsize - 1;
+			length -= opsize;
+		}
+	}
+	return 0;
+}
+
+/* Length of the DATA_ACK within the DSS-option */
+static inline int mptcp_gro_ack_len(const struct mp_dss *mdss)
+{
+	if (!mdss->A)
+		return 0;
+
+	return mdss->a ? MPTCP_SUB_LEN_ACK_64 : MPTCP_SUB_LEN_ACK;
+}
+
+/* Called by tcp_gro_receive if the options of the segment th differ from the
+ * ones of the held segment th2. They may still be merged if both carry the
+ * same DSS-mapping (a multi-MSS mapping spans several segments) and only
+ * the DATA_ACK differs.
+ *
+ * The mapping itself is never rewritten. Otherwise, a mapping that does not
+ * end within the merged segment would not match anymore the one carried by
+ * the following segments, and mptcp_detect_mapping() resets the subflow.
+ *
+ * Returns 1 if the segments can be merged, 0 if they have to be flushed.
+ */
+int mptcp_gro_receive(const struct tcphdr *th, const struct tcphdr *th2)
+{
+	struct mp_dss *mdss, *mdss2;
+	int off, ack_len, thlen = th->doff * 4;
+
+	off = mptcp_gro_dss_off(th2);
+	if (!off || off != mptcp_gro_dss_off(th))
+		return 0;
+
+	mdss = (struct mp_dss *)((u8 *)th + off);
+	mdss2 = (struct mp_dss *)((u8 *)th2 + off);
+
+	/* Same DSS-flags. DATA_FIN has to stay on its own segment. */
+	if (memcmp(mdss, mdss2, 4) || !mdss->M || mdss->F ||
+	    mdss->len < mptcp_sub_len_dss(mdss, 0) || off + mdss->len > thlen)
+		return 0;
+
+	/* All the other options must be the same */
+	if (memcmp(th + 1, th2 + 1, off - sizeof(*th)) ||
+	    memcmp((u8 *)mdss + mdss->len, (u8 *)mdss2 + mdss->len,
+		   thlen - off - mdss->len))
+		return 0;
+
+	/* The same mapping (and DSS-checksum, if any) */
+	ack_len = mptcp_gro_ack_len(mdss);
+	if (memcmp((u8 *)(mdss + 1) + ack_len, (u8 *)(mdss2 + 1) + ack_len,
+		   mdss->len - sizeof(*mdss) - ack_len))
+		return 0;
+
+	return 1;
+}
+
+/* The merged segment th2 carries the DATA_ACK of th, the latest one */
+void mptcp_gro_update_dss(struct tcphdr *th2, const struct tcphdr *th)
+{
+	int off = mptcp_gro_dss_off(th);
+	struct mp_dss *mdss;
+
+	if (!off)
+		return;
+
+	mdss = (struct mp_dss *)((u8 *)th + off);
+	memcpy((u8 *)th2 + off + sizeof(*mdss), mdss + 1,
+	       mptcp_gro_ack_len(mdss));
+}
+
+/* Memory needed in the receive-queue for space bytes of payload */
+static int mptcp_rcvmem(const struct tcp_sock *meta_tp, int space)
+{
+	int rcvmem = meta_tp->advmss + MAX_TCP_HEADER + 16 +
+		     sizeof(struct sk_buff);
+
+	while (tcp_win_from_space(rcvmem) < meta_tp->advmss)
+		rcvmem += 128;
+
+	return max_t(int, space / meta_tp->advmss, 1) * rcvmem;
+}
+
+/* Receive-buffer autotuning of the meta-socket, in place of the one of
+ * tcp_rcv_space_adjust().
+ *
+ * To avoid head-of-line blocking, the buffer has to hold what all the
+ * subflows deliver within the largest of their RTTs, because the segments
+ * of the fast subflows wait in the out-of-order queue for those of the
+ * slowest one. Thus, once per max-RTT, we measure what the subflows
+ * delivered (their rcv_nxt advanced from rcvq_space.seq) and aim at:
+ *
+ *	space = 2 * sum(rate_i) * max(rtt_i)
+ *
+ * Like for TCP, the factor 2 leaves room for the senders to grow. The
+ * buffer grows right away, but shrinks by at most a quarter per period,
+ * never below its initial size nor below what the peer may still send
+ * within the window we announced.
+ *
+ * The periods in which the free space limited the announced window (see
+ * __mptcp_select_window) are counted in MPTCPRcvWndLimited.
+ */
+void mptcp_rcv_space_adjust(struct sock *meta_sk)
+{
+	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
+	struct mptcp_cb *mpcb = meta_tp->mpcb;
+	u64 delivered = 0;
+	u32 rtt_max = 0, time;
 	struct sock *sk;
-	u32 rtt_max = 0;
+	int space, rcvbuf;
+
+	if (meta_tp->rcvq_space.time == 0)
+		goto new_measure;
 
-	/* In MPTCP, we take the max delay across all flows,
-	 * in order to take into account meta-reordering buffers.
-	 */
 	mptcp_for_each_sk(mpcb, sk) {
+		struct tcp_sock *tp = tcp_sk(sk);
+
 		if (!mptcp_sk_can_recv(sk))
 			continue;
 
-		if (rtt_max < tcp_sk(sk)->rcv_rtt_est.rtt)
-			rtt_max = tcp_sk(sk)->rcv_rtt_est.rtt;
+		if (rtt_max < tp->rcv_rtt_est.rtt)
+			rtt_max = tp->rcv_rtt_est.rtt;
+		delivered += tp->rcv_nxt - tp->rcvq_space.seq;
 	}
+
+	time = tcp_time_stamp - meta_tp->rcvq_space.time;
 	if (time < (rtt_max >> 3) || !rtt_max)
-		return 1;
+		return;
 
-	return 0;
+	/* The free space limited the announced window in this period */
+	if (mpcb->rcv_wnd_limited)
+		NET_INC_STATS(sock_net(meta_sk), LINUX_MIB_MPTCPRCVWNDLIMITED);
+
+	/* rcv_rtt_est.rtt is scaled by 8 */
+	space = min_t(u64, div_u64(delivered * rtt_max, time << 2), INT_MAX);
+	if (space >= meta_tp->rcvq_space.space)
+		meta_tp->rcvq_space.space = space;
+	else
+		meta_tp->rcvq_space.space = max(space, meta_tp->rcvq_space.space -
+						(meta_tp->rcvq_space.space >> 2));
+	space = meta_tp->rcvq_space.space;
+
+	if (!sysctl_tcp_moderate_rcvbuf ||
+	    (meta_sk->sk_userlocks & SOCK_RCVBUF_LOCK))
+		goto new_measure;
+
+	rcvbuf = min(mptcp_rcvmem(meta_tp, space), sysctl_tcp_rmem[2]);
+	if (rcvbuf > meta_sk->sk_rcvbuf) {
+		meta_sk->sk_rcvbuf = rcvbuf;
+
+		/* Make the window clamp follow along.  */
+		meta_tp->window_clamp = space;
+		NET_INC_STATS(sock_net(meta_sk), LINUX_MIB_MPTCPRCVBUFGROW);
+	} else {
+		rcvbuf = max(rcvbuf, mpcb->orig_sk_rcvbuf);
+		rcvbuf = max(rcvbuf, atomic_read(&meta_sk->sk_rmem_alloc) +
+			     mptcp_rcvmem(meta_tp, tcp_receive_window(meta_tp)));
+		if (rcvbuf >= meta_sk->sk_rcvbuf)
+			goto new_measure;
+
+		meta_sk->sk_rcvbuf = rcvbuf;
+		meta_tp->window_clamp = max_t(u32, space,
+					      tcp_receive_window(meta_tp));
+		meta_tp->rcv_ssthresh = min(meta_tp->rcv_ssthresh,
+					    meta_tp->window_clamp);
+		NET_INC_STATS(sock_net(meta_sk), LINUX_MIB_MPTCPRCVBUFSHRINK);
+	}
+
+new_measure:
+	mptcp_for_each_sk(mpcb, sk)
+		tcp_sk(sk)->rcvq_space.seq = tcp_sk(sk)->rcv_nxt;
+
+	mpcb->rcv_wnd_limited = 0;
+	meta_tp->rcvq_space.seq = meta_tp->copied_seq;
+	meta_tp->rcvq_space.time = tcp_time_stamp;
 }
 
 static void mptcp_handle_add_addr(const unsigned char *ptr, struct sock *sk)
@@ -1494,16 +1793,24 @@ static void mptcp_handle_add_addr(const unsigned char *ptr, struct sock *sk)
 		if (mpadd->len == MPTCP_SUB_LEN_ADD_ADDR4 + 2)
 			port  = mpadd->u.v4.port;
 
-		mptcp_v4_add_raddress(tcp_sk(sk)->mpcb, &mpadd->u.v4.addr, port,
-				      mpadd->addr_id);
+		if (!mptcp_v4_add_raddress(tcp_sk(sk)->mpcb, &mpadd->u.v4.addr,
+					   port, mpadd->addr_id))
+			mptcp_genl_addr_event(tcp_sk(sk)->mpcb,
+					      MPTCP_EVENT_ANNOUNCED, AF_INET,
+					      &mpadd->u.v4.addr, port,
+					      mpadd->addr_id);
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	} else if (mpadd->ipver == 6) {
 		__be16 port = 0;
 		if (mpadd->len == MPTCP_SUB_LEN_ADD_ADDR6 + 2)
 			port  = mpadd->u.v6.port;
 
-		mptcp_v6_add_raddress(tcp_sk(sk)->mpcb, &mpadd->u.v6.addr, port,
-				      mpadd->addr_id);
+		if (!mptcp_v6_add_raddress(tcp_sk(sk)->mpcb, &mpadd->u.v6.addr,
+					   port, mpadd->addr_id))
+			mptcp_genl_addr_event(tcp_sk(sk)->mpcb,
+					      MPTCP_EVENT_ANNOUNCED, AF_INET6,
+					      &mpadd->u.v6.addr, port,
+					      mpadd->addr_id);
 #endif /* CONFIG_IPV6 */
 	}
 }
@@ -1516,8 +1823,12 @@ static void mptcp_handle_rem_addr(const unsigned char *ptr, struct sock *sk)
 
 	for (i = 0; i <= mprem->len - MPTCP_SUB_LEN_REMOVE_ADDR; i++) {
 		rem_id = (&mprem->addrs_id)[i];
-		if (!mptcp_rem_raddress(tcp_sk(sk)->mpcb, rem_id))
+		if (!mptcp_rem_raddress(tcp_sk(sk)->mpcb, rem_id)) {
 			mptcp_send_reset_rem_id(tcp_sk(sk)->mpcb, rem_id);
+			mptcp_genl_addr_event(tcp_sk(sk)->mpcb,
+					      MPTCP_EVENT_REMOVED, AF_UNSPEC,
+					      NULL, 0, rem_id);
+		}
 	}
 }
 
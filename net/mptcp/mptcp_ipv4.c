@@ -70,9 +70,10 @@ static void mptcp_v4_reqsk_queue_hash_add(struct sock *meta_sk,
 
 	inet_csk_reqsk_queue_hash_add(meta_sk, req, timeout);
 
-	spin_lock(&mptcp_reqsk_hlock);
+	mptcp_rsk(req)->collide_hash = h;
+	spin_lock(&mptcp_reqsk_hlock[h]);
 	list_add(&mptcp_rsk(req)->collide_tuple, &mptcp_reqsk_htb[h]);
-	spin_unlock(&mptcp_reqsk_hlock);
+	spin_unlock(&mptcp_reqsk_hlock[h]);
 }
 
 /* Similar to tcp_v4_conn_request */
@@ -90,7 +91,6 @@ static void mptcp_v4_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	__be32 saddr = ip_hdr(skb)->saddr;
 	__be32 daddr = ip_hdr(skb)->daddr;
 	__u32 isn = TCP_SKB_CB(skb)->when;
-	int want_cookie = 0;
 
 	tcp_clear_options(&tmp_opt);
 	mptcp_init_mp_opt(&mopt);
@@ -98,6 +98,15 @@ static void mptcp_v4_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	tmp_opt.user_mss = tcp_sk(meta_sk)->rx_opt.user_mss;
 	tcp_parse_options(skb, &tmp_opt, &hash_location, &mopt, 0);
 
+	/* An MP_JOIN cannot be answered with a syncookie, because the HMAC of
+	 * the third ACK covers the nonce of the SYN. The SYN-queue of the
+	 * meta-sk bounds instead the state kept per connection.
+	 */
+	if (inet_csk_reqsk_queue_is_full(meta_sk)) {
+		NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_LISTENDROPS);
+		return;
+	}
+
 	req = inet_reqsk_alloc(&mptcp_request_sock_ops);
 	if (!req)
 		return;
@@ -113,8 +122,7 @@ static void mptcp_v4_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	mtreq->mptcp_loc_key = mpcb->mptcp_loc_key;
 	get_random_bytes(&mtreq->mptcp_loc_nonce,
 			 sizeof(mtreq->mptcp_loc_nonce));
-	mptcp_hmac_sha1((u8 *)&mtreq->mptcp_loc_key,
-			(u8 *)&mtreq->mptcp_rem_key,
+	mptcp_hmac_sha1(&mpcb->hmac_loc,
 			(u8 *)&mtreq->mptcp_loc_nonce,
 			(u8 *)&mtreq->mptcp_rem_nonce, (u32 *)mptcp_hash_mac);
 	mtreq->mptcp_hash_tmac = *(u64 *)mptcp_hash_mac;
@@ -131,8 +139,7 @@ static void mptcp_v4_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	if (security_inet_conn_request(meta_sk, skb, req))
 		goto drop_and_free;
 
-	if (!want_cookie || tmp_opt.tstamp_ok)
-		TCP_ECN_create_request(req, tcp_hdr(skb));
+	TCP_ECN_create_request(req, tcp_hdr(skb));
 
 	if (!isn) {
 		struct inet_peer *peer = NULL;
@@ -201,13 +208,10 @@ int mptcp_v4_rem_raddress(struct mptcp_cb *mpcb, u8 id)
 {
 	int i;
 
-	for (i = 0; i < MPTCP_MAX_ADDR; i++) {
-		if (!((1 << i) & mpcb->rem4_bits))
-			continue;
-
+	mptcp_for_each_bit_set(mpcb->rem4_bits, i) {
 		if (mpcb->remaddr4[i].id == id) {
 			/* remove address from bitfield */
-			mpcb->rem4_bits &= ~(1 << i);
+			mpcb->rem4_bits &= ~(1U << i);
 
 			return 0;
 		}
@@ -254,7 +258,7 @@ int mptcp_v4_add_raddress(struct mptcp_cb *mpcb, const struct in_addr *addr,
 
 	i = mptcp_find_free_index(mpcb->rem4_bits);
 	/* Do we have already the maximum number of local/remote addresses? */
-	if (i < 0) {
+	if (i < 0 || mptcp_addr_reserve(mpcb, remaddr4, i)) {
 		mptcp_debug("%s: At max num of remote addresses: %d --- not adding address: %pI4\n",
 			    __func__, MPTCP_MAX_ADDR, &addr->s_addr);
 		return -1;
@@ -269,7 +273,7 @@ int mptcp_v4_add_raddress(struct mptcp_cb *mpcb, const struct in_addr *addr,
 	rem4->retry_bitfield = 0;
 	rem4->id = id;
 	mpcb->list_rcvd = 1;
-	mpcb->rem4_bits |= (1 << i);
+	mpcb->rem4_bits |= (1U << i);
 
 	return 0;
 }
@@ -297,7 +301,7 @@ int mptcp_v4_do_rcv(struct sock *meta_sk, struct sk_buff *skb)
 	struct sock *child, *rsk = NULL;
 	int ret;
 
-	if (!(TCP_SKB_CB(skb)->mptcp_flags & MPTCPHDR_JOIN)) {
+	if (TCP_SKB_CB(skb)->mptcp_flags != MPTCPHDR_JOIN) {
 		struct tcphdr *th = tcp_hdr(skb);
 		const struct iphdr *iph = ip_hdr(skb);
 		struct sock *sk;
@@ -390,14 +394,12 @@ discard:
 struct sock *mptcp_v4_search_req(const __be16 rport, const __be32 raddr,
 				 const __be32 laddr, const struct net *net)
 {
+	const u32 h = inet_synq_hash(raddr, rport, 0, MPTCP_HASH_SIZE);
 	struct mptcp_request_sock *mtreq;
 	struct sock *meta_sk = NULL;
 
-	spin_lock(&mptcp_reqsk_hlock);
-	list_for_each_entry(mtreq,
-			    &mptcp_reqsk_htb[inet_synq_hash(raddr, rport, 0,
-							    MPTCP_HASH_SIZE)],
-			    collide_tuple) {
+	spin_lock(&mptcp_reqsk_hlock[h]);
+	list_for_each_entry(mtreq, &mptcp_reqsk_htb[h], collide_tuple) {
 		struct inet_request_sock *ireq = inet_rsk(rev_mptcp_rsk(mtreq));
 		meta_sk = mtreq->mpcb->meta_sk;
 
@@ -412,7 +414,7 @@ struct sock *mptcp_v4_search_req(const __be16 rport, const __be32 raddr,
 
 	if (meta_sk && unlikely(!atomic_inc_not_zero(&meta_sk->sk_refcnt)))
 		meta_sk = NULL;
-	spin_unlock(&mptcp_reqsk_hlock);
+	spin_unlock(&mptcp_reqsk_hlock[h]);
 
 	return meta_sk;
 }
@@ -431,7 +433,7 @@ int mptcp_init4_subsockets(struct sock *meta_sk, const struct mptcp_loc4 *loc,
 	int ulid_size = 0, ret;
 
 	/* Don't try again - even if it fails */
-	rem->bitfield |= (1 << loc->id);
+	rem->bitfield |= (1U << loc->id);
 
 	/** First, create and prepare the new socket */
 
@@ -460,8 +462,16 @@ int mptcp_init4_subsockets(struct sock *meta_sk, const struct mptcp_loc4 *loc,
 	tp->mptcp->slave_sk = 1;
 	tp->mptcp->low_prio = loc->low_prio;
 
-	/* Initializing the timer for an MPTCP subflow */
-	setup_timer(&tp->mptcp->mptcp_ack_timer, mptcp_ack_handler, (unsigned long)sk);
+	/* Initializing the timer for an MPTCP subflow. Only the MP_JOINs we
+	 * send need it, thus it is allocated here.
+	 */
+	tp->mptcp->mptcp_ack_timer = kmalloc(sizeof(struct timer_list),
+					     GFP_KERNEL);
+	if (!tp->mptcp->mptcp_ack_timer) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	setup_timer(tp->mptcp->mptcp_ack_timer, mptcp_ack_handler, (unsigned long)sk);
 
 	/** Then, connect the socket to the peer */
 
@@ -520,7 +530,17 @@ error:
 static int mptcp_pm_inetaddr_event(struct notifier_block *this,
 				   unsigned long event, void *ptr)
 {
-	return mptcp_pm_addr_event_handler(event, ptr, AF_INET);
+	struct in_ifaddr *ifa = (struct in_ifaddr *)ptr;
+	struct mptcp_addr_event ev;
+
+	if (!(event == NETDEV_UP || event == NETDEV_DOWN ||
+	      event == NETDEV_CHANGE))
+		return NOTIFY_DONE;
+
+	if (mptcp_v4_fill_addr_event(ifa, event, &ev))
+		return NOTIFY_DONE;
+
+	return mptcp_pm_addr_event_handler(dev_net(ifa->ifa_dev->dev), &ev);
 }
 
 /* React on ifup/down-events */
@@ -537,10 +557,8 @@ static int mptcp_pm_netdev_event(struct notifier_block *this,
 	if (dev->flags & IFF_NOMULTIPATH)
 		return NOTIFY_DONE;
 
-	/* Iterate over the addresses of the interface, then we go over the
-	 * mpcb's to modify them - that way we take tk_hash_lock for a shorter
-	 * time at each iteration. - otherwise we would need to take it from the
-	 * beginning till the end.
+	/* Each address of the interface becomes a separate address-event,
+	 * handled later on by the path-manager's worker.
 	 */
 	rcu_read_lock();
 	in_dev = __in_dev_get_rcu(dev);
@@ -555,35 +573,53 @@ static int mptcp_pm_netdev_event(struct notifier_block *this,
 	return NOTIFY_DONE;
 }
 
-void mptcp_pm_addr4_event_handler(struct in_ifaddr *ifa, unsigned long event,
+/* Describes the event on ifa in ev. Returns -1 if MPTCP must not use ifa. */
+int mptcp_v4_fill_addr_event(struct in_ifaddr *ifa, unsigned long event,
+			     struct mptcp_addr_event *ev)
+{
+	struct net_device *dev = ifa->ifa_dev->dev;
+
+	if (ifa->ifa_scope > RT_SCOPE_LINK || (dev->flags & IFF_NOMULTIPATH))
+		return -1;
+
+	ev->family = AF_INET;
+	ev->code = event;
+	ev->down_first = 0;
+	ev->low_prio = (dev->flags & IFF_MPBACKUP) ? 1 : 0;
+	ev->if_running = netif_running(dev) ? 1 : 0;
+	ev->addr.in.s_addr = ifa->ifa_local;
+
+	return 0;
+}
+
+void mptcp_pm_addr4_event_handler(const struct mptcp_addr_event *event,
 				  struct mptcp_cb *mpcb)
 {
 	int i;
 	struct sock *sk, *tmpsk;
 
-	if (ifa->ifa_scope > RT_SCOPE_LINK ||
-	    (ifa->ifa_dev->dev->flags & IFF_NOMULTIPATH))
-		return;
-
 	/* Look for the address among the local addresses */
 	mptcp_for_each_bit_set(mpcb->loc4_bits, i) {
-		if (mpcb->locaddr4[i].addr.s_addr == ifa->ifa_local)
+		if (mpcb->locaddr4[i].addr.s_addr == event->addr.in.s_addr)
 			goto found;
 	}
 
 	/* Not yet in address-list */
-	if ((event == NETDEV_UP || event == NETDEV_CHANGE) && netif_running(ifa->ifa_dev->dev)) {
+	if ((event->code == NETDEV_UP || event->code == NETDEV_CHANGE) &&
+	    event->if_running) {
 		i = __mptcp_find_free_index(mpcb->loc4_bits, 0, mpcb->next_v4_index);
-		if (i < 0) {
+		if (i < 0 || mptcp_addr_reserve(mpcb, locaddr4, i) ||
+		    mptcp_pm_addr_index(mpcb, AF_INET, &event->addr.in)) {
 			mptcp_debug("MPTCP_PM: NETDEV_UP Reached max number of local IPv4 addresses: %d\n",
 				    MPTCP_MAX_ADDR);
 			return;
 		}
 
 		/* update this mpcb */
-		mpcb->locaddr4[i].addr.s_addr = ifa->ifa_local;
+		mpcb->locaddr4[i].addr.s_addr = event->addr.in.s_addr;
 		mpcb->locaddr4[i].id = i;
-		mpcb->loc4_bits |= (1 << i);
+		mpcb->locaddr4[i].low_prio = event->low_prio;
+		mpcb->loc4_bits |= (1U << i);
 		mpcb->next_v4_index = i + 1;
 		/* re-send addresses */
 		mptcp_v4_send_add_addr(i, mpcb);
@@ -592,31 +628,33 @@ void mptcp_pm_addr4_event_handler(struct in_ifaddr *ifa, unsigned long event,
 	}
 	return;
 found:
+	if (event->code == NETDEV_CHANGE)
+		mpcb->locaddr4[i].low_prio = event->low_prio;
+
 	/* Address already in list. Reactivate/Deactivate the
 	 * concerned paths. */
 	mptcp_for_each_sk_safe(mpcb, sk, tmpsk) {
 		struct tcp_sock *tp = tcp_sk(sk);
 		if (sk->sk_family != AF_INET ||
-		    inet_sk(sk)->inet_saddr != ifa->ifa_local)
+		    inet_sk(sk)->inet_saddr != event->addr.in.s_addr)
 			continue;
 
-		if (event == NETDEV_DOWN) {
+		if (event->code == NETDEV_DOWN) {
 			mptcp_reinject_data(sk, 0);
 			mptcp_sub_force_close(sk);
-		} else if (event == NETDEV_CHANGE) {
-			int new_low_prio = (ifa->ifa_dev->dev->flags & IFF_MPBACKUP) ?
-						1 : 0;
-			if (new_low_prio != tp->mptcp->low_prio)
+		} else if (event->code == NETDEV_CHANGE) {
+			if (event->low_prio != tp->mptcp->low_prio)
 				tp->mptcp->send_mp_prio = 1;
-			tp->mptcp->low_prio = new_low_prio;
+			tp->mptcp->low_prio = event->low_prio;
 		}
 	}
 
-	if (event == NETDEV_DOWN) {
-		mpcb->loc4_bits &= ~(1 << i);
+	if (event->code == NETDEV_DOWN) {
+		mptcp_pm_addr_unindex(mpcb, AF_INET, &mpcb->locaddr4[i].addr);
+		mpcb->loc4_bits &= ~(1U << i);
 
 		/* Force sending directly the REMOVE_ADDR option */
-		mpcb->remove_addrs |= (1 << mpcb->locaddr4[i].id);
+		mpcb->remove_addrs |= (1ULL << mpcb->locaddr4[i].id);
 		sk = mptcp_select_ack_sock(mpcb->meta_sk, 0);
 		if (sk)
 			tcp_send_ack(sk);
@@ -632,7 +670,7 @@ void mptcp_v4_send_add_addr(int loc_id, struct mptcp_cb *mpcb)
 	struct tcp_sock *tp;
 
 	mptcp_for_each_tp(mpcb, tp)
-		tp->mptcp->add_addr4 |= (1 << loc_id);
+		tp->mptcp->add_addr4 |= (1U << loc_id);
 }
 
 static struct notifier_block mptcp_pm_inetaddr_notifier = {
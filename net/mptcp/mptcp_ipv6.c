@@ -85,9 +85,10 @@ static void mptcp_v6_reqsk_queue_hash_add(struct sock *meta_sk,
 
 	inet6_csk_reqsk_queue_hash_add(meta_sk, req, timeout);
 
-	spin_lock(&mptcp_reqsk_hlock);
+	mptcp_rsk(req)->collide_hash = h;
+	spin_lock(&mptcp_reqsk_hlock[h]);
 	list_add(&mptcp_rsk(req)->collide_tuple, &mptcp_reqsk_htb[h]);
-	spin_unlock(&mptcp_reqsk_hlock);
+	spin_unlock(&mptcp_reqsk_hlock[h]);
 }
 
 /* Similar to tcp_v6_send_synack
@@ -276,7 +277,6 @@ static void mptcp_v6_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	u8 mptcp_hash_mac[20];
 	__u32 isn = TCP_SKB_CB(skb)->when;
 	struct dst_entry *dst = NULL;
-	int want_cookie = 0;
 
 	tcp_clear_options(&tmp_opt);
 	mptcp_init_mp_opt(&mopt);
@@ -284,6 +284,15 @@ static void mptcp_v6_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	tmp_opt.user_mss  = tcp_sk(meta_sk)->rx_opt.user_mss;
 	tcp_parse_options(skb, &tmp_opt, &hash_location, &mopt, 0);
 
+	/* An MP_JOIN cannot be answered with a syncookie, because the HMAC of
+	 * the third ACK covers the nonce of the SYN. The SYN-queue of the
+	 * meta-sk bounds instead the state kept per connection.
+	 */
+	if (inet_csk_reqsk_queue_is_full(meta_sk)) {
+		NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_LISTENDROPS);
+		return;
+	}
+
 	req = inet6_reqsk_alloc(&mptcp6_request_sock_ops);
 	if (!req)
 		return;
@@ -299,8 +308,7 @@ static void mptcp_v6_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	mtreq->mptcp_loc_key = mpcb->mptcp_loc_key;
 	get_random_bytes(&mtreq->mptcp_loc_nonce,
 			 sizeof(mtreq->mptcp_loc_nonce));
-	mptcp_hmac_sha1((u8 *)&mtreq->mptcp_loc_key,
-			(u8 *)&mtreq->mptcp_rem_key,
+	mptcp_hmac_sha1(&mpcb->hmac_loc,
 			(u8 *)&mtreq->mptcp_loc_nonce,
 			(u8 *)&mtreq->mptcp_rem_nonce, (u32 *)mptcp_hash_mac);
 	mtreq->mptcp_hash_tmac = *(u64 *)mptcp_hash_mac;
@@ -312,8 +320,7 @@ static void mptcp_v6_join_request(struct sock *meta_sk, struct sk_buff *skb)
 	ipv6_addr_copy(&treq->rmt_addr, &ipv6_hdr(skb)->saddr);
 	ipv6_addr_copy(&treq->loc_addr, &ipv6_hdr(skb)->daddr);
 
-	if (!want_cookie || tmp_opt.tstamp_ok)
-		TCP_ECN_create_request(req, tcp_hdr(skb));
+	TCP_ECN_create_request(req, tcp_hdr(skb));
 
 	treq->iif = meta_sk->sk_bound_dev_if;
 
@@ -403,13 +410,10 @@ int mptcp_v6_rem_raddress(struct mptcp_cb *mpcb, u8 id)
 {
 	int i;
 
-	for (i = 0; i < MPTCP_MAX_ADDR; i++) {
-		if (!((1 << i) & mpcb->rem6_bits))
-			continue;
-
+	mptcp_for_each_bit_set(mpcb->rem6_bits, i) {
 		if (mpcb->remaddr6[i].id == id) {
 			/* remove address from bitfield */
-			mpcb->rem6_bits &= ~(1 << i);
+			mpcb->rem6_bits &= ~(1U << i);
 
 			return 0;
 		}
@@ -454,7 +458,7 @@ int mptcp_v6_add_raddress(struct mptcp_cb *mpcb, const struct in6_addr *addr,
 
 	i = mptcp_find_free_index(mpcb->rem6_bits);
 	/* Do we have already the maximum number of local/remote addresses? */
-	if (i < 0) {
+	if (i < 0 || mptcp_addr_reserve(mpcb, remaddr6, i)) {
 		mptcp_debug("%s: At max num of remote addresses: %d --- not adding address: %pI6\n",
 			    __func__, MPTCP_MAX_ADDR, addr);
 		return -1;
@@ -469,7 +473,7 @@ int mptcp_v6_add_raddress(struct mptcp_cb *mpcb, const struct in6_addr *addr,
 	rem6->retry_bitfield = 0;
 	rem6->id = id;
 	mpcb->list_rcvd = 1;
-	mpcb->rem6_bits |= (1 << i);
+	mpcb->rem6_bits |= (1U << i);
 
 	return 0;
 }
@@ -496,7 +500,7 @@ int mptcp_v6_do_rcv(struct sock *meta_sk, struct sk_buff *skb)
 	struct sock *child, *rsk = NULL;
 	int ret;
 
-	if (!(TCP_SKB_CB(skb)->mptcp_flags & MPTCPHDR_JOIN)) {
+	if (TCP_SKB_CB(skb)->mptcp_flags != MPTCPHDR_JOIN) {
 		struct tcphdr *th = tcp_hdr(skb);
 		const struct ipv6hdr *ip6h = ipv6_hdr(skb);
 		struct sock *sk;
@@ -590,14 +594,12 @@ discard:
 struct sock *mptcp_v6_search_req(const __be16 rport, const struct in6_addr *raddr,
 				 const struct in6_addr *laddr, const struct net *net)
 {
+	const u32 h = inet6_synq_hash(raddr, rport, 0, MPTCP_HASH_SIZE);
 	struct mptcp_request_sock *mtreq;
 	struct sock *meta_sk = NULL;
 
-	spin_lock(&mptcp_reqsk_hlock);
-	list_for_each_entry(mtreq,
-			    &mptcp_reqsk_htb[inet6_synq_hash(raddr, rport, 0,
-							     MPTCP_HASH_SIZE)],
-			    collide_tuple) {
+	spin_lock(&mptcp_reqsk_hlock[h]);
+	list_for_each_entry(mtreq, &mptcp_reqsk_htb[h], collide_tuple) {
 		struct inet6_request_sock *treq = inet6_rsk(rev_mptcp_rsk(mtreq));
 		meta_sk = mtreq->mpcb->meta_sk;
 
@@ -612,7 +614,7 @@ struct sock *mptcp_v6_search_req(const __be16 rport, const struct in6_addr *radd
 
 	if (meta_sk && unlikely(!atomic_inc_not_zero(&meta_sk->sk_refcnt)))
 		meta_sk = NULL;
-	spin_unlock(&mptcp_reqsk_hlock);
+	spin_unlock(&mptcp_reqsk_hlock[h]);
 
 	return meta_sk;
 }
@@ -634,7 +636,7 @@ int mptcp_init6_subsockets(struct sock *meta_sk, const struct mptcp_loc6 *loc,
 	 * There is a special case as the IPv6 address of the initial subflow
 	 * has an id = 0. The other ones have id's in the range [8, 16[.
 	 */
-	rem->bitfield |= (1 << (loc->id - min_t(u8, loc->id, MPTCP_MAX_ADDR)));
+	rem->bitfield |= (1U << (loc->id - min_t(u8, loc->id, MPTCP_MAX_ADDR)));
 
 	/** First, create and prepare the new socket */
 
@@ -663,8 +665,16 @@ int mptcp_init6_subsockets(struct sock *meta_sk, const struct mptcp_loc6 *loc,
 	tp->mptcp->slave_sk = 1;
 	tp->mptcp->low_prio = loc->low_prio;
 
-	/* Initializing the timer for an MPTCP subflow */
-	setup_timer(&tp->mptcp->mptcp_ack_timer, mptcp_ack_handler, (unsigned long)sk);
+	/* Initializing the timer for an MPTCP subflow. Only the MP_JOINs we
+	 * send need it, thus it is allocated here.
+	 */
+	tp->mptcp->mptcp_ack_timer = kmalloc(sizeof(struct timer_list),
+					     GFP_KERNEL);
+	if (!tp->mptcp->mptcp_ack_timer) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	setup_timer(tp->mptcp->mptcp_ack_timer, mptcp_ack_handler, (unsigned long)sk);
 
 	/** Then, connect the socket to the peer */
 
@@ -777,12 +787,22 @@ static inline void mptcp_dad_setup_timer(struct inet6_ifaddr *ifa)
 static int mptcp_pm_inet6_addr_event(struct notifier_block *this,
 				     unsigned long event, void *ptr)
 {
-	if (mptcp_ipv6_is_in_dad_state((struct inet6_ifaddr *)ptr)) {
-		mptcp_dad_setup_timer((struct inet6_ifaddr *)ptr);
+	struct inet6_ifaddr *ifa6 = (struct inet6_ifaddr *)ptr;
+	struct mptcp_addr_event ev;
+
+	if (!(event == NETDEV_UP || event == NETDEV_DOWN ||
+	      event == NETDEV_CHANGE))
+		return NOTIFY_DONE;
+
+	if (mptcp_ipv6_is_in_dad_state(ifa6)) {
+		mptcp_dad_setup_timer(ifa6);
 		return NOTIFY_DONE;
-	} else {
-		return mptcp_pm_addr_event_handler(event, ptr, AF_INET6);
 	}
+
+	if (mptcp_v6_fill_addr_event(ifa6, event, &ev))
+		return NOTIFY_DONE;
+
+	return mptcp_pm_addr_event_handler(dev_net(ifa6->idev->dev), &ev);
 }
 
 /* React on ifup/down-events */
@@ -796,10 +816,8 @@ static int mptcp_pm_v6_netdev_event(struct notifier_block *this,
 	      event == NETDEV_CHANGE))
 		return NOTIFY_DONE;
 
-	/* Iterate over the addresses of the interface, then we go over the
-	 * mpcb's to modify them - that way we take tk_hash_lock for a shorter
-	 * time at each iteration. - otherwise we would need to take it from the
-	 * beginning till the end.
+	/* Each address of the interface becomes a separate address-event,
+	 * handled later on by the path-manager's worker.
 	 */
 	rcu_read_lock();
 	in6_dev = __in6_dev_get(dev);
@@ -814,40 +832,59 @@ static int mptcp_pm_v6_netdev_event(struct notifier_block *this,
 	return NOTIFY_DONE;
 }
 
-void mptcp_pm_addr6_event_handler(struct inet6_ifaddr *ifa, unsigned long event,
-				  struct mptcp_cb *mpcb)
+/* Describes the event on ifa in ev. Returns -1 if MPTCP must not use ifa. */
+int mptcp_v6_fill_addr_event(struct inet6_ifaddr *ifa, unsigned long event,
+			     struct mptcp_addr_event *ev)
 {
-	int i;
-	struct sock *sk, *tmpsk;
+	struct net_device *dev = ifa->idev->dev;
 	int addr_type = ipv6_addr_type(&ifa->addr);
 
 	/* Checks on interface and address-type */
 	if (ifa->scope > RT_SCOPE_LINK ||
-	    (ifa->idev->dev->flags & IFF_NOMULTIPATH) ||
+	    (dev->flags & IFF_NOMULTIPATH) ||
 	    addr_type == IPV6_ADDR_ANY ||
 	    (addr_type & IPV6_ADDR_LOOPBACK) ||
 	    (addr_type & IPV6_ADDR_LINKLOCAL))
-		return;
+		return -1;
+
+	ev->family = AF_INET6;
+	ev->code = event;
+	ev->down_first = 0;
+	ev->low_prio = (dev->flags & IFF_MPBACKUP) ? 1 : 0;
+	ev->if_running = netif_running(dev) ? 1 : 0;
+	ipv6_addr_copy(&ev->addr.in6, &ifa->addr);
+
+	return 0;
+}
+
+void mptcp_pm_addr6_event_handler(const struct mptcp_addr_event *event,
+				  struct mptcp_cb *mpcb)
+{
+	int i;
+	struct sock *sk, *tmpsk;
 
 	/* Look for the address among the local addresses */
 	mptcp_for_each_bit_set(mpcb->loc6_bits, i) {
-		if (ipv6_addr_equal(&mpcb->locaddr6[i].addr, &ifa->addr))
+		if (ipv6_addr_equal(&mpcb->locaddr6[i].addr, &event->addr.in6))
 			goto found;
 	}
 
 	/* Not yet in address-list */
-	if ((event == NETDEV_UP || event == NETDEV_CHANGE) && netif_running(ifa->idev->dev)) {
+	if ((event->code == NETDEV_UP || event->code == NETDEV_CHANGE) &&
+	    event->if_running) {
 		i = __mptcp_find_free_index(mpcb->loc6_bits, 0, mpcb->next_v6_index);
-		if (i < 0) {
+		if (i < 0 || mptcp_addr_reserve(mpcb, locaddr6, i) ||
+		    mptcp_pm_addr_index(mpcb, AF_INET6, &event->addr.in6)) {
 			mptcp_debug("MPTCP_PM: NETDEV_UP Reached max number of local IPv6 addresses: %d\n",
 				    MPTCP_MAX_ADDR);
 			return;
 		}
 
 		/* update this mpcb */
-		ipv6_addr_copy(&mpcb->locaddr6[i].addr, &ifa->addr);
+		ipv6_addr_copy(&mpcb->locaddr6[i].addr, &event->addr.in6);
 		mpcb->locaddr6[i].id = i + MPTCP_MAX_ADDR;
-		mpcb->loc6_bits |= (1 << i);
+		mpcb->locaddr6[i].low_prio = event->low_prio;
+		mpcb->loc6_bits |= (1U << i);
 		mpcb->next_v6_index = i + 1;
 		/* re-send addresses */
 		mptcp_v6_send_add_addr(i, mpcb);
@@ -856,31 +893,33 @@ void mptcp_pm_addr6_event_handler(struct inet6_ifaddr *ifa, unsigned long event,
 	}
 	return;
 found:
+	if (event->code == NETDEV_CHANGE)
+		mpcb->locaddr6[i].low_prio = event->low_prio;
+
 	/* Address already in list. Reactivate/Deactivate the
 	 * concerned paths. */
 	mptcp_for_each_sk_safe(mpcb, sk, tmpsk) {
 		struct tcp_sock *tp = tcp_sk(sk);
 		if (sk->sk_family != AF_INET6 ||
-		    !ipv6_addr_equal(&inet6_sk(sk)->saddr, &ifa->addr))
+		    !ipv6_addr_equal(&inet6_sk(sk)->saddr, &event->addr.in6))
 			continue;
 
-		if (event == NETDEV_DOWN) {
+		if (event->code == NETDEV_DOWN) {
 			mptcp_reinject_data(sk, 0);
 			mptcp_sub_force_close(sk);
-		} else if (event == NETDEV_CHANGE) {
-			int new_low_prio = (ifa->idev->dev->flags & IFF_MPBACKUP) ?
-						1 : 0;
-			if (new_low_prio != tp->mptcp->low_prio)
+		} else if (event->code == NETDEV_CHANGE) {
+			if (event->low_prio != tp->mptcp->low_prio)
 				tp->mptcp->send_mp_prio = 1;
-			tp->mptcp->low_prio = new_low_prio;
+			tp->mptcp->low_prio = event->low_prio;
 		}
 	}
 
-	if (event == NETDEV_DOWN) {
-		mpcb->loc6_bits &= ~(1 << i);
+	if (event->code == NETDEV_DOWN) {
+		mptcp_pm_addr_unindex(mpcb, AF_INET6, &mpcb->locaddr6[i].addr);
+		mpcb->loc6_bits &= ~(1U << i);
 
 		/* Force sending directly the REMOVE_ADDR option */
-		mpcb->remove_addrs |= (1 << mpcb->locaddr6[i].id);
+		mpcb->remove_addrs |= (1ULL << mpcb->locaddr6[i].id);
 		sk = mptcp_select_ack_sock(mpcb->meta_sk, 0);
 		if (sk)
 			tcp_send_ack(sk);
@@ -896,7 +935,7 @@ void mptcp_v6_send_add_addr(int loc_id, struct mptcp_cb *mpcb)
 	struct tcp_sock *tp;
 
 	mptcp_for_each_tp(mpcb, tp)
-		tp->mptcp->add_addr6 |= (1 << loc_id);
+		tp->mptcp->add_addr6 |= (1U << loc_id);
 }
 
 
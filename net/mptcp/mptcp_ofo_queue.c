@@ -26,137 +26,126 @@
  *      2 of the License, or (at your option) any later version.
  */
 
+#include <linux/rbtree.h>
 #include <linux/skbuff.h>
 #include <linux/slab.h>
 #include <net/tcp.h>
 #include <net/mptcp.h>
 
-static void mptcp_remove_shortcuts(const struct mptcp_cb *mpcb,
-				   const struct sk_buff *skb)
+#include <trace/events/mptcp.h>
+
+/* The meta-level out-of-order queue is kept as a list, ordered by
+ * data-sequence number, in meta_tp->out_of_order_queue. The list is indexed
+ * by a red-black tree (mpcb->ofo_rb), whose nodes are embedded in the
+ * control-buffer of the skbs. This way, the insertion point is found in
+ * O(log n), even if many subflows with very different RTTs make the queue
+ * grow to thousands of segments.
+ */
+
+static inline struct sk_buff *mptcp_ofo_skb(struct rb_node *node)
 {
-	struct tcp_sock *tp;
+	struct tcp_skb_cb *tcb = rb_entry(node, struct tcp_skb_cb, ofo_node);
 
-	mptcp_for_each_tp(mpcb, tp) {
-		if (tp->mptcp->shortcut_ofoqueue == skb) {
-			tp->mptcp->shortcut_ofoqueue = NULL;
-			return;
-		}
-	}
+	return (struct sk_buff *)((char *)tcb - offsetof(struct sk_buff, cb));
 }
 
-/* Does 'skb' fits after 'here' in the queue 'head' ?
- * If yes, we queue it and return 1
+static void mptcp_ofo_unlink(struct tcp_sock *meta_tp, struct sk_buff *skb)
+{
+	__skb_unlink(skb, &meta_tp->out_of_order_queue);
+	rb_erase(&TCP_SKB_CB(skb)->ofo_node, &meta_tp->mpcb->ofo_rb);
+}
+
+/* Try to append the payload of 'from' to 'to', which ends exactly where
+ * 'from' starts. As in tcp_collapse, we only copy into the tailroom of
+ * 'to', so that no memory gets allocated.
+ *
+ * Returns 1 if 'from' has been merged into 'to' and freed.
  */
-static int mptcp_ofo_queue_after(struct sk_buff_head *head, struct sk_buff *skb,
-				struct sk_buff *here)
+static int mptcp_ofo_try_coalesce(struct sock *meta_sk, struct sk_buff *to,
+				  struct sk_buff *from)
 {
-	u32 seq = TCP_SKB_CB(skb)->seq;
-	u32 end_seq = TCP_SKB_CB(skb)->end_seq;
+	int len = from->len;
 
-	/* We want to queue skb after here, thus seq >= end_seq */
-	if (before(seq, TCP_SKB_CB(here)->end_seq))
+	if (tcp_hdr(to)->fin || tcp_hdr(from)->fin)
 		return 0;
 
-	/* If here is the last one, we can always queue it */
-	if (skb_queue_is_last(head, here)) {
-		__skb_queue_after(head, here, skb);
-		return 1;
-	} else {
-		struct sk_buff *skb1 = skb_queue_next(head, here);
-		/* It's not the last one, but does it fits between 'here' and
-		 * the one after 'here' ? Thus, does end_seq <= after_here->seq
-		 */
-		if (!after(end_seq, TCP_SKB_CB(skb1)->seq)) {
-			__skb_queue_after(head, here, skb);
-			return 1;
-		}
-	}
+	if (skb_cloned(to) || len > skb_tailroom(to))
+		return 0;
 
-	return 0;
+	if (skb_copy_bits(from, 0, skb_put(to, len), len))
+		BUG();
+
+	TCP_SKB_CB(to)->end_seq = TCP_SKB_CB(from)->end_seq;
+	__kfree_skb(from);
+
+	NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_MPTCPOFOMERGE);
+
+	return 1;
 }
 
-static int try_shortcut(struct sk_buff *shortcut, struct sk_buff *skb,
-			struct sk_buff_head *head, struct mptcp_cb *mpcb)
+/**
+ * @sk: the subflow that received this skb.
+ */
+void mptcp_add_meta_ofo_queue(struct sock *meta_sk, struct sk_buff *skb,
+			      struct sock *sk)
 {
-	struct tcp_sock *tp;
-	struct sk_buff *skb1, *best_shortcut = NULL;
+	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
+	struct sk_buff_head *head = &meta_tp->out_of_order_queue;
+	struct rb_root *root = &meta_tp->mpcb->ofo_rb;
+	struct rb_node **p = &root->rb_node, *parent = NULL;
+	struct sk_buff *skb1 = NULL;
 	u32 seq = TCP_SKB_CB(skb)->seq;
 	u32 end_seq = TCP_SKB_CB(skb)->end_seq;
-	u32 distance = 0xffffffff;
+	unsigned int steps = 0;
 
-	/* First, check the tp's shortcut */
-	if (!shortcut) {
-		if (skb_queue_empty(head)) {
-			__skb_queue_head(head, skb);
-			return 0;
-		}
-	} else {
-		/* Does the tp's shortcut is a hit? If yes, we insert. */
-		if (mptcp_ofo_queue_after(head, skb, shortcut))
-			goto clean_covered;
-	}
+	trace_mptcp_ofo_queue(meta_sk, sk, skb);
 
-	/* Check the shortcuts of the other subsockets. */
-	mptcp_for_each_tp(mpcb, tp) {
-		shortcut = tp->mptcp->shortcut_ofoqueue;
-		/* Can we queue it here? If yes, do so! */
-		if (shortcut && mptcp_ofo_queue_after(head, skb, shortcut))
-			goto clean_covered;
+	/* Find skb1, the last one with skb1->seq <= seq */
+	while (*p) {
+		struct sk_buff *tmp;
 
-		/* Could not queue it, check if we are close.
-		 * We are looking for a shortcut, close enough to seq to
-		 * set skb1 prematurely and thus improve the subsequent lookup,
-		 * which tries to find a skb1 so that skb1->seq <= seq.
-		 *
-		 * So, here we only take shortcuts, whose shortcut->seq > seq,
-		 * and minimize the distance between shortcut->seq and seq and
-		 * set best_shortcut to this one with the minimal distance.
-		 *
-		 * That way, the subsequent while-loop is shortest.
-		 */
-		if (shortcut && after(TCP_SKB_CB(shortcut)->seq, seq)) {
-			/* Are we closer than the current best shortcut? */
-			if ((u32)(seq - TCP_SKB_CB(shortcut)->seq) < distance) {
-				distance = (u32)(seq - TCP_SKB_CB(shortcut)->seq);
-				best_shortcut = shortcut;
-			}
-		}
-	}
+		parent = *p;
+		tmp = mptcp_ofo_skb(parent);
+		steps++;
 
-	if (best_shortcut)
-		skb1 = best_shortcut;
-	else
-		skb1 = skb_peek_tail(head);
-
-	/* Find the insertion point, starting from best_shortcut if available.
-	 *
-	 * Inspired from tcp_data_queue.
-	 */
-	while (1) {
-		/* skb1->seq <= seq */
-		if (!after(TCP_SKB_CB(skb1)->seq, seq))
-			break;
-		if (skb_queue_is_first(head, skb1)) {
-			skb1 = NULL;
-			break;
+		if (after(TCP_SKB_CB(tmp)->seq, seq)) {
+			p = &parent->rb_left;
+		} else {
+			skb1 = tmp;
+			p = &parent->rb_right;
 		}
-		skb1 = skb_queue_prev(head, skb1);
 	}
 
-	/* Do skb overlap to previous one? */
+	NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_MPTCPOFOQUEUE);
+	NET_ADD_STATS_BH(sock_net(meta_sk), LINUX_MIB_MPTCPOFOQUEUESTEPS, steps);
+
 	if (skb1 && before(seq, TCP_SKB_CB(skb1)->end_seq)) {
 		if (!after(end_seq, TCP_SKB_CB(skb1)->end_seq)) {
 			/* All the bits are present. */
 			__kfree_skb(skb);
-			return 1;
+			return;
 		}
 		if (seq == TCP_SKB_CB(skb1)->seq) {
-			if (skb_queue_is_first(head, skb1))
-				skb1 = NULL;
-			else
-				skb1 = skb_queue_prev(head, skb1);
+			/* skb covers skb1 entirely - take its place */
+			rb_replace_node(&TCP_SKB_CB(skb1)->ofo_node,
+					&TCP_SKB_CB(skb)->ofo_node, root);
+			__skb_queue_after(head, skb1, skb);
+			__skb_unlink(skb1, head);
+			__kfree_skb(skb1);
+			goto clean_covered;
 		}
 	}
+
+	/* Adjacent to the previous one? Then, try to merge both. */
+	if (skb1 && seq == TCP_SKB_CB(skb1)->end_seq &&
+	    mptcp_ofo_try_coalesce(meta_sk, skb1, skb)) {
+		skb = skb1;
+		goto clean_covered;
+	}
+
+	rb_link_node(&TCP_SKB_CB(skb)->ofo_node, parent, p);
+	rb_insert_color(&TCP_SKB_CB(skb)->ofo_node, root);
+
 	if (!skb1)
 		__skb_queue_head(head, skb);
 	else
@@ -169,29 +158,12 @@ clean_covered:
 
 		if (!after(end_seq, TCP_SKB_CB(skb1)->seq))
 			break;
+		if (before(end_seq, TCP_SKB_CB(skb1)->end_seq))
+			break;
 
-		__skb_unlink(skb1, head);
-		mptcp_remove_shortcuts(mpcb, skb1);
+		mptcp_ofo_unlink(meta_tp, skb1);
 		__kfree_skb(skb1);
 	}
-	return 0;
-}
-
-/**
- * @sk: the subflow that received this skb.
- */
-void mptcp_add_meta_ofo_queue(struct sock *meta_sk, struct sk_buff *skb,
-			      struct sock *sk)
-{
-	int ans;
-	struct tcp_sock *tp = tcp_sk(sk);
-
-	ans = try_shortcut(tp->mptcp->shortcut_ofoqueue, skb,
-			   &tcp_sk(meta_sk)->out_of_order_queue, tp->mpcb);
-
-	/* update the shortcut pointer in @sk */
-	if (!ans)
-		tp->mptcp->shortcut_ofoqueue = skb;
 }
 
 void mptcp_ofo_queue(struct sock *meta_sk)
@@ -203,16 +175,13 @@ void mptcp_ofo_queue(struct sock *meta_sk)
 		if (after(TCP_SKB_CB(skb)->seq, meta_tp->rcv_nxt))
 			break;
 
+		mptcp_ofo_unlink(meta_tp, skb);
+
 		if (!after(TCP_SKB_CB(skb)->end_seq, meta_tp->rcv_nxt)) {
-			__skb_unlink(skb, &meta_tp->out_of_order_queue);
-			mptcp_remove_shortcuts(meta_tp->mpcb, skb);
 			__kfree_skb(skb);
 			continue;
 		}
 
-		__skb_unlink(skb, &meta_tp->out_of_order_queue);
-		mptcp_remove_shortcuts(meta_tp->mpcb, skb);
-
 		__skb_queue_tail(&meta_sk->sk_receive_queue, skb);
 		mptcp_check_rcvseq_wrap(meta_tp, TCP_SKB_CB(skb)->end_seq -
 						 meta_tp->rcv_nxt);
@@ -225,12 +194,6 @@ void mptcp_ofo_queue(struct sock *meta_sk)
 
 void mptcp_purge_ofo_queue(struct tcp_sock *meta_tp)
 {
-	struct sk_buff_head *head = &meta_tp->out_of_order_queue;
-	struct sk_buff *skb, *tmp;
-
-	skb_queue_walk_safe(head, skb, tmp) {
-		__skb_unlink(skb, head);
-		mptcp_remove_shortcuts(meta_tp->mpcb, skb);
-		kfree_skb(skb);
-	}
+	__skb_queue_purge(&meta_tp->out_of_order_queue);
+	meta_tp->mpcb->ofo_rb = RB_ROOT;
 }
@@ -27,155 +27,14 @@
  *      2 of the License, or (at your option) any later version.
  */
 
+#include <linux/module.h>
 #include <linux/skbuff.h>
 #include <linux/tcp.h>
 
 #include <net/mptcp.h>
 #include <net/sock.h>
 
-/* If the sub-socket sk available to send the skb? */
-static int mptcp_is_available(struct sock *sk, struct sk_buff *skb)
-{
-	struct tcp_sock *tp = tcp_sk(sk);
-
-	/* Set of states for which we are allowed to send data */
-	if (!mptcp_sk_can_send(sk))
-		return 0;
-
-	/* We do not send data on this subflow unless it is
-	 * fully established, i.e. the 4th ack has been received.
-	 */
-	if (tp->mptcp->pre_established)
-		return 0;
-
-	if (tp->pf ||
-	    (tp->mpcb->noneligible & mptcp_pi_to_flag(tp->mptcp->path_index)))
-		return 0;
-
-	if (inet_csk(sk)->icsk_ca_state == TCP_CA_Loss) {
-		/* If SACK is disabled, and we got a loss, TCP does not exist
-		 * the loss-state until something above high_seq has been acked.
-		 * (see tcp_try_undo_recovery)
-		 *
-		 * high_seq is the snd_nxt at the moment of the RTO. As soon
-		 * as we have an RTO, we won't push data on the subflow.
-		 * Thus, snd_una can never go beyond high_seq.
-		 */
-		if (!tcp_is_reno(tp))
-			return 0;
-		else if (tp->snd_una != tp->high_seq)
-			return 0;
-	}
-
-	if (!tp->mptcp->fully_established) {
-		/* Make sure that we send in-order data */
-		if (skb && tp->mptcp->second_packet &&
-		    tp->mptcp->last_end_data_seq != TCP_SKB_CB(skb)->seq)
-			return 0;
-	}
-
-	/* Don't send on this subflow if we bypass the allowed send-window at
-	 * the per-subflow level. Similar to tcp_snd_wnd_test, but manually
-	 * calculated end_seq (because here at this point end_seq is still at
-	 * the meta-level).
-	 */
-	if (skb && after(tp->write_seq + skb->len, tcp_wnd_end(tp)))
-		return 0;
-
-	return tcp_cwnd_test(tp, skb);
-}
-
-/* Are we not allowed to reinject this skb on tp? */
-static int mptcp_dont_reinject_skb(struct tcp_sock *tp, struct sk_buff *skb)
-{
-	/* If the skb has already been enqueued in this sk, try to find
-	 * another one.
-	 * An exception is a DATA_FIN without data. These ones are not
-	 * reinjected at the subflow-level as they do not consume
-	 * subflow-sequence-number space.
-	 */
-	return skb &&
-		/* We either have a data_fin with data or not a data_fin */
-		((mptcp_is_data_fin(skb) && TCP_SKB_CB(skb)->end_seq - TCP_SKB_CB(skb)->seq  > 1) ||
-		!mptcp_is_data_fin(skb)) &&
-		/* Has the skb already been enqueued into this subsocket? */
-		mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask;
-}
-
-/* This is the scheduler. This function decides on which flow to send
- * a given MSS. If all subflows are found to be busy, NULL is returned
- * The flow is selected based on the shortest RTT.
- * If all paths have full cong windows, we simply return NULL.
- *
- * Additionally, this function is aware of the backup-subflows.
- */
-static struct sock *get_available_subflow(struct sock *meta_sk,
-					  struct sk_buff *skb)
-{
-	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
-	struct sock *sk, *bestsk = NULL, *lowpriosk = NULL, *backupsk = NULL;
-	u32 min_time_to_peer = 0xffffffff, lowprio_min_time_to_peer = 0xffffffff;
-	int cnt_backups = 0;
-
-	/* if there is only one subflow, bypass the scheduling function */
-	if (mpcb->cnt_subflows == 1) {
-		bestsk = (struct sock *)mpcb->connection_list;
-		if (!mptcp_is_available(bestsk, skb))
-			bestsk = NULL;
-		return bestsk;
-	}
-
-	/* Answer data_fin on same subflow!!! */
-	if (meta_sk->sk_shutdown & RCV_SHUTDOWN &&
-	    skb && mptcp_is_data_fin(skb)) {
-		mptcp_for_each_sk(mpcb, sk) {
-			if (tcp_sk(sk)->mptcp->path_index == mpcb->dfin_path_index &&
-			    mptcp_is_available(sk, skb))
-				return sk;
-		}
-	}
-
-	/* First, find the best subflow */
-	mptcp_for_each_sk(mpcb, sk) {
-		struct tcp_sock *tp = tcp_sk(sk);
-		if (tp->mptcp->rcv_low_prio || tp->mptcp->low_prio)
-			cnt_backups++;
-
-		if (!mptcp_is_available(sk, skb))
-			continue;
-
-		if (mptcp_dont_reinject_skb(tp, skb)) {
-			backupsk = sk;
-			continue;
-		}
-
-		if ((tp->mptcp->rcv_low_prio || tp->mptcp->low_prio) &&
-		    tp->srtt < lowprio_min_time_to_peer &&
-		    !(skb && mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask)) {
-			lowprio_min_time_to_peer = tp->srtt;
-			lowpriosk = sk;
-		} else if (!(tp->mptcp->rcv_low_prio || tp->mptcp->low_prio) &&
-		    tp->srtt < min_time_to_peer &&
-		    !(skb && mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask)) {
-			min_time_to_peer = tp->srtt;
-			bestsk = sk;
-		}
-	}
-
-	if (mpcb->cnt_established == cnt_backups && lowpriosk)
-		return lowpriosk;
-	if (bestsk)
-		return bestsk;
-	if (backupsk) {
-		/* It has been sent on all subflows once - let's give it a
-		 * chance again by restarting its pathmask.
-		 */
-		if (skb)
-			TCP_SKB_CB(skb)->path_mask = 0;
-		return backupsk;
-	}
-	return NULL;
-}
+#include <trace/events/mptcp.h>
 
 static struct mp_dss *mptcp_skb_find_dss(const struct sk_buff *skb)
 {
@@ -219,7 +78,14 @@ static int mptcp_reconstruct_mapping(struct sk_buff *skb, struct sk_buff *orig_s
 	return 0;
 }
 
-/* Similar to __pskb_copy and sk_stream_alloc_skb. */
+/* Similar to __pskb_copy and sk_stream_alloc_skb.
+ *
+ * Only the linear part is copied. The page-fragments are shared with skb,
+ * each subskb holding a reference on the pages. As the meta-level segments
+ * are built in pages whenever the subflows support scatter-gather (see
+ * mptcp_sk_can_sg), the payload is not copied on the send-path. The new
+ * skb just provides the headroom for its TCP-header and DSS-option.
+ */
 static struct sk_buff *mptcp_pskb_copy(struct sk_buff *skb)
 {
 	struct sk_buff *n;
@@ -232,10 +98,12 @@ static struct sk_buff *mptcp_pskb_copy(struct sk_buff *skb)
 
 	/* Set the data pointer */
 	skb_reserve(n, MAX_TCP_HEADER);
-	/* Set the tail pointer and length */
-	skb_put(n, skb_headlen(skb));
-	/* Copy the bytes */
-	skb_copy_from_linear_data(skb, n->data, n->len);
+	if (skb_headlen(skb)) {
+		/* Set the tail pointer and length */
+		skb_put(n, skb_headlen(skb));
+		/* Copy the bytes */
+		skb_copy_from_linear_data(skb, n->data, n->len);
+	}
 
 	n->truesize += skb->data_len;
 	n->data_len  = skb->data_len;
@@ -325,6 +193,8 @@ static void __mptcp_reinject_data(struct sk_buff *orig_skb, struct sock *meta_sk
 		return;
 	}
 
+	trace_mptcp_reinject(meta_sk, sk, skb);
+
 	/* If it's empty, just add */
 	if (skb_queue_empty(&mpcb->reinject_queue)) {
 		skb_queue_head(&mpcb->reinject_queue, skb);
@@ -510,6 +380,16 @@ static struct sk_buff *mptcp_skb_entail(struct sock *sk, struct sk_buff **skb,
 	if (!subskb)
 		return NULL;
 
+	tp->mptcp->bytes_sched += (*skb)->len;
+	if (reinject) {
+		tp->mptcp->bytes_reinj += (*skb)->len;
+		/* No RTT-sample from it anymore, see mptcp_clean_rtx_queue */
+		TCP_SKB_CB(*skb)->sacked |= TCPCB_EVER_RETRANS;
+	} else {
+		/* First transmission, for mptcp_rtt_estimator */
+		TCP_SKB_CB(*skb)->when = tcp_time_stamp;
+	}
+
 	TCP_SKB_CB(*skb)->path_mask |= mptcp_pi_to_flag(tp->mptcp->path_index);
 
 	if (!(sk->sk_route_caps & NETIF_F_ALL_CSUM) &&
@@ -525,6 +405,12 @@ static struct sk_buff *mptcp_skb_entail(struct sock *sk, struct sk_buff **skb,
 	tcb = TCP_SKB_CB(subskb);
 	tcb->path_mask = 0;
 
+	/* A multi-MSS segment is sent as a single GSO-skb on the subflow. All
+	 * the resulting segments carry the same DSS-mapping.
+	 */
+	if (tcp_skb_pcount(subskb) > 1)
+		tcp_set_skb_tso_segs(sk, subskb, tcp_skb_mss(subskb));
+
 	if (mptcp_is_data_fin(subskb))
 		mptcp_combine_dfin(subskb, meta_sk, sk);
 
@@ -790,6 +676,12 @@ int mptcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 	TCP_SKB_CB(buff)->when = TCP_SKB_CB(skb)->when;
 	buff->tstamp = skb->tstamp;
 
+	/* At the meta-level, buff has been sent on the same subflows as skb.
+	 * On a subflow, the path-mask is a union with inet_skb_param.
+	 */
+	if (is_meta_sk(sk))
+		TCP_SKB_CB(buff)->path_mask = TCP_SKB_CB(skb)->path_mask;
+
 	old_factor = tcp_skb_pcount(skb);
 
 	/* Fix up tso_factor for both original and new SKB.  */
@@ -858,8 +750,18 @@ int mptso_fragment(struct sock *sk, struct sk_buff *skb, unsigned int len,
 	TCP_SKB_CB(skb)->mptcp_flags = flags & ~(MPTCPHDR_FIN);
 	TCP_SKB_CB(buff)->mptcp_flags = flags;
 
-	/* This packet was never sent out yet, so no SACK bits. */
-	TCP_SKB_CB(buff)->sacked = 0;
+	/* This packet was never sent out yet on the subflow, so no SACK bits.
+	 * At the meta-level, an opportunistic retransmission may split a
+	 * segment that has already been sent more than once.
+	 */
+	TCP_SKB_CB(buff)->sacked = TCP_SKB_CB(skb)->sacked & TCPCB_EVER_RETRANS;
+
+	/* The tail of a segment already sent at the meta-level keeps its
+	 * first transmission time and the subflows it has been sent on.
+	 */
+	TCP_SKB_CB(buff)->when = TCP_SKB_CB(skb)->when;
+	if (is_meta_sk(sk))
+		TCP_SKB_CB(buff)->path_mask = TCP_SKB_CB(skb)->path_mask;
 
 	buff->ip_summed = CHECKSUM_PARTIAL;
 	skb->ip_summed = CHECKSUM_PARTIAL;
@@ -908,7 +810,7 @@ int mptcp_write_wakeup(struct sock *meta_sk)
 		int err;
 		unsigned int mss;
 		unsigned int seg_size = tcp_wnd_end(meta_tp) - TCP_SKB_CB(skb)->seq;
-		struct sock *subsk = get_available_subflow(meta_sk, skb);
+		struct sock *subsk = mptcp_get_subflow(meta_sk, skb);
 		if (!subsk)
 			return -1;
 		mss = tcp_current_mss(subsk);
@@ -991,6 +893,7 @@ static void mptcp_mark_reinjected(struct sock *sk, struct sk_buff *skb)
 
 		if (TCP_SKB_CB(skb_it)->seq == TCP_SKB_CB(skb)->seq) {
 			TCP_SKB_CB(skb_it)->path_mask |= mptcp_pi_to_flag(tp->mptcp->path_index);
+			TCP_SKB_CB(skb_it)->sacked |= TCPCB_EVER_RETRANS;
 			break;
 		}
 	}
@@ -1013,11 +916,42 @@ static void mptcp_find_and_set_pathmask(struct sock *meta_sk, struct sk_buff *sk
 	}
 }
 
-static struct sk_buff *mptcp_rcv_buf_optimization(struct sock *sk, int penal)
+/* Predicted time (in jiffies, scaled like srtt) until a segment, queued now
+ * on the subflow, gets acknowledged: it has to wait until the segments
+ * already in flight have left, and then needs one RTT.
+ */
+static u32 mptcp_sub_delivery_time(const struct tcp_sock *tp)
+{
+	u32 cwnd = max(tp->snd_cwnd, 1U);
+
+	return (u32)div_u64((u64)tp->srtt * (cwnd + tp->packets_out), cwnd);
+}
+
+/* Predicted time (in jiffies, scaled like srtt) until skb, sent on the
+ * subflow tp at TCP_SKB_CB(skb)->when, gets acknowledged.
+ */
+static u32 mptcp_sub_remaining_time(const struct tcp_sock *tp,
+				    const struct sk_buff *skb)
+{
+	u32 elapsed = (tcp_time_stamp - TCP_SKB_CB(skb)->when) << 3;
+
+	/* Later than expected - it will take at least another RTT */
+	if (elapsed >= tp->srtt)
+		return tp->srtt;
+
+	return tp->srtt - elapsed;
+}
+
+/* The head of the meta send-queue blocks the peer's receive-buffer, while
+ * it is in flight on another (slower) subflow. Penalize that subflow and
+ * retransmit the head on sk, if it would arrive earlier this way.
+ */
+struct sk_buff *mptcp_rcv_buf_optimization(struct sock *sk, int penal)
 {
 	struct sock *meta_sk;
 	struct tcp_sock *tp = tcp_sk(sk), *tp_it;
 	struct sk_buff *skb_head;
+	u32 delivery, meta_rtt;
 
 	if (tp->mpcb->cnt_subflows == 1)
 		return NULL;
@@ -1028,6 +962,8 @@ static struct sk_buff *mptcp_rcv_buf_optimization(struct sock *sk, int penal)
 	if (!skb_head || skb_head == tcp_send_head(meta_sk))
 		return NULL;
 
+	delivery = mptcp_sub_delivery_time(tp);
+
 	/* If penalization is optional (coming from mptcp_next_segment() and
 	 * We are not send-buffer-limited we do not penalize. The retransmission
 	 * is just an optimization to fix the idle-time due to the delay before
@@ -1036,19 +972,30 @@ static struct sk_buff *mptcp_rcv_buf_optimization(struct sock *sk, int penal)
 	if (!penal && sk_stream_memory_free(meta_sk))
 		goto retrans;
 
+	/* Usual time until data gets DATA_ACKed, see mptcp_rtt_estimator */
+	meta_rtt = tcp_sk(meta_sk)->srtt ? : tp->srtt;
+
 	/* Half the cwnd of the slow flow */
 	mptcp_for_each_tp(tp->mpcb, tp_it) {
 		if (tp_it != tp &&
 		    TCP_SKB_CB(skb_head)->path_mask & mptcp_pi_to_flag(tp_it->mptcp->path_index)) {
+			u32 remaining;
+
 			/* Only update every subflow rtt */
 			if (tcp_time_stamp - tp_it->mptcp->last_rbuf_opti < tp_it->srtt >> 3)
 				break;
 
-			if ((u64)tp_it->snd_cwnd * tp->srtt <
-			    (u64) tp->snd_cwnd * tp_it->srtt) {
+			/* Only if it holds back the head for longer than it
+			 * usually takes to get data DATA_ACKed, and if we
+			 * would have been faster.
+			 */
+			remaining = mptcp_sub_remaining_time(tp_it, skb_head);
+			if (remaining > meta_rtt && remaining > delivery) {
 				tp_it->snd_cwnd = max(tp_it->snd_cwnd >> 1U, 1U);
 				tp_it->snd_ssthresh = max(tp_it->snd_cwnd, 2U);
 				tp_it->mptcp->last_rbuf_opti = tcp_time_stamp;
+
+				trace_mptcp_rcvbuf_penal(sk, (struct sock *)tp_it);
 			}
 			break;
 		}
@@ -1067,7 +1014,8 @@ retrans:
 					break;
 				}
 
-				if (4 * tp->srtt >= tp_it->srtt) {
+				/* It will arrive earlier on tp_it */
+				if (mptcp_sub_remaining_time(tp_it, skb_head) <= delivery) {
 					do_retrans = 0;
 					break;
 				} else {
@@ -1076,11 +1024,111 @@ retrans:
 			}
 		}
 
-		if (do_retrans)
+		if (do_retrans) {
+			trace_mptcp_rcvbuf_retrans(sk, skb_head, penal);
 			return skb_head;
+		}
 	}
 	return NULL;
 }
+EXPORT_SYMBOL_GPL(mptcp_rcv_buf_optimization);
+
+/* Similar to tcp_mss_split_point, but the segment must also fit in the
+ * send-window of the subflow it is going to be sent on.
+ */
+static unsigned int mptcp_mss_split_point(struct sock *meta_sk,
+					  struct sock *subsk,
+					  struct sk_buff *skb,
+					  unsigned int mss_now,
+					  unsigned int cwnd)
+{
+	struct tcp_sock *subtp = tcp_sk(subsk);
+	u32 limit, sub_window;
+
+	limit = tcp_mss_split_point(meta_sk, skb, mss_now, cwnd);
+
+	sub_window = tcp_wnd_end(subtp) - subtp->write_seq;
+	if (sub_window < limit)
+		limit = max(sub_window - sub_window % mss_now, mss_now);
+
+	return limit;
+}
+
+/* Meta-level segments are built in page-fragments if all subflows on which
+ * they may be scheduled support scatter-gather.
+ */
+int mptcp_sk_can_sg(const struct sock *meta_sk)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sock *sk;
+	int can_sg = 0;
+
+	if (!mpcb)
+		return 0;
+
+	mptcp_for_each_sk(mpcb, sk) {
+		if (!mptcp_sk_can_send(sk))
+			continue;
+
+		if (!(sk->sk_route_caps & NETIF_F_SG))
+			return 0;
+
+		can_sg = 1;
+	}
+
+	return can_sg;
+}
+
+/* The pages of sendpage can only be referenced if no checksum over the
+ * payload has to be computed in software: no DSS-checksum, and all subflows
+ * support scatter-gather and hw-csum.
+ */
+int mptcp_sk_can_sendpage(const struct sock *meta_sk)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sock *sk;
+
+	if (!mpcb || mpcb->dss_csum || !mptcp_sk_can_sg(meta_sk))
+		return 0;
+
+	mptcp_for_each_sk(mpcb, sk) {
+		if (!mptcp_sk_can_send(sk))
+			continue;
+
+		if (!(sk->sk_route_caps & NETIF_F_ALL_CSUM))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Can we build segments bigger than one MSS at the meta-level? Only if
+ * all subflows on which they may be scheduled support GSO.
+ *
+ * With the DSS-checksum, the payload-checksum is computed in software at
+ * the meta-level. We thus stick to MSS-sized segments in this case.
+ */
+int mptcp_sk_can_gso(const struct sock *meta_sk)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sock *sk;
+	int can_gso = 0;
+
+	if (!mpcb || mpcb->dss_csum)
+		return 0;
+
+	mptcp_for_each_sk(mpcb, sk) {
+		if (!mptcp_sk_can_send(sk))
+			continue;
+
+		if (!sk_can_gso(sk))
+			return 0;
+
+		can_gso = 1;
+	}
+
+	return can_gso;
+}
 
 int mptcp_write_xmit(struct sock *meta_sk, unsigned int mss_now, int nonagle,
 		     int push_one, gfp_t gfp)
@@ -1096,7 +1144,10 @@ int mptcp_write_xmit(struct sock *meta_sk, unsigned int mss_now, int nonagle,
 
 	sent_pkts = 0;
 
-	/* Currently mtu-probing is not done in MPTCP */
+	/* Currently mtu-probing is not done in MPTCP. tcp_mtu_probe works on
+	 * the path-MTU of a single socket, which does not exist at the
+	 * meta-level.
+	 */
 	if (!push_one && 0) {
 		/* Do MTU probing. */
 		result = tcp_mtu_probe(meta_sk);
@@ -1126,28 +1177,27 @@ int mptcp_write_xmit(struct sock *meta_sk, unsigned int mss_now, int nonagle,
 				mptcp_find_and_set_pathmask(meta_sk, skb);
 		}
 
-		subsk = get_available_subflow(meta_sk, skb);
+		subsk = mptcp_get_subflow(meta_sk, skb);
 		if (!subsk)
 			break;
 		subtp = tcp_sk(subsk);
 		mss_now = tcp_current_mss(subsk);
 
-		/* This must be invoked even if we don't want
-		 * to support TSO at the moment
-		 */
-		tso_segs = tcp_init_tso_segs(meta_sk, skb, mss_now);
-		BUG_ON(!tso_segs);
-
-		/* At the moment we do not support tso, hence
-		 * tso_segs must be 1
-		 */
-		BUG_ON(tso_segs != 1);
-
 		/* Since all subsocks are locked before calling the scheduler,
 		 * the tcp_send_head should not change.
 		 */
 		BUG_ON(!reinject && tcp_send_head(meta_sk) != skb);
 retry:
+		/* An opportunistic retransmission has already been accounted
+		 * in the meta's packets_out. Its pcount may only change through
+		 * mptso_fragment.
+		 */
+		if (reinject == -1)
+			tso_segs = tcp_skb_pcount(skb);
+		else
+			tso_segs = tcp_init_tso_segs(meta_sk, skb, mss_now);
+		BUG_ON(!tso_segs);
+
 		cwnd_quota = tcp_cwnd_test(subtp, skb);
 		if (!cwnd_quota) {
 			/* May happen, if at the first selection we circumvented
@@ -1168,20 +1218,19 @@ retry:
 			break;
 		}
 
-		if (tso_segs == 1) {
-			if (unlikely(!tcp_nagle_test(meta_tp, skb, mss_now,
-						     (tcp_skb_is_last(meta_sk, skb) ?
-						      nonagle : TCP_NAGLE_PUSH))))
-				break;
-		} else {
-			if (!push_one && tcp_tso_should_defer(meta_sk, skb))
-				break;
-		}
+		/* tcp_tso_should_defer is not used, as it relies on the cwnd
+		 * and send-window of a single socket. Segments bigger than
+		 * one MSS always pass the Nagle-test.
+		 */
+		if (unlikely(!tcp_nagle_test(meta_tp, skb, mss_now,
+					     (tcp_skb_is_last(meta_sk, skb) ?
+					      nonagle : TCP_NAGLE_PUSH))))
+			break;
 
 		limit = mss_now;
-		if (!meta_tp->mpc && tso_segs > 1 && !tcp_urg_mode(meta_tp))
-			limit = tcp_mss_split_point(meta_sk, skb, mss_now,
-						    cwnd_quota);
+		if (tso_segs > 1 && sk_can_gso(subsk) && !tcp_urg_mode(meta_tp))
+			limit = mptcp_mss_split_point(meta_sk, subsk, skb,
+						      mss_now, cwnd_quota);
 
 		if (skb->len > limit &&
 		    unlikely(mptso_fragment(meta_sk, skb, limit, mss_now, gfp, reinject)))
@@ -1260,6 +1309,7 @@ u32 __mptcp_select_window(struct sock *sk)
 
 	if (free_space < (full_space >> 1)) {
 		icsk->icsk_ack.quick = 0;
+		tp->mpcb->rcv_wnd_limited = 1;
 
 		if (tcp_memory_pressure)
 			/* TODO this has to be adapted when we support different
@@ -1390,6 +1440,24 @@ void mptcp_synack_options(struct request_sock *req,
 	}
 }
 
+/* The lowest address-ids of remove_addrs, as many as fit in a REMOVE_ADDR
+ * option of at most space bytes.
+ */
+static u64 mptcp_remove_addrs_fit(u64 remove_addrs, int space)
+{
+	int max_ids = (space & ~3) - MPTCP_SUB_LEN_REMOVE_ADDR + 1;
+	u64 addrs = 0;
+
+	while (remove_addrs && max_ids-- > 0) {
+		u64 lowest = remove_addrs & (~remove_addrs + 1);
+
+		addrs |= lowest;
+		remove_addrs &= ~lowest;
+	}
+
+	return addrs;
+}
+
 void mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 			       struct tcp_out_options *opts, unsigned *size)
 {
@@ -1455,8 +1523,7 @@ void mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 			*size += MPTCP_SUB_LEN_JOIN_ACK_ALIGN;
 
 			if (skb)
-				mptcp_hmac_sha1((u8 *)&mpcb->mptcp_loc_key,
-						(u8 *)&mpcb->mptcp_rem_key,
+				mptcp_hmac_sha1(&mpcb->hmac_loc,
 						(u8 *)&tp->mptcp->mptcp_loc_nonce,
 						(u8 *)&tp->mptcp->rx_opt.mptcp_recv_nonce,
 						(u32 *)opts->mp_join_ack.sender_mac);
@@ -1493,7 +1560,7 @@ void mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 		opts->mptcp_options |= OPTION_ADD_ADDR;
 		opts->addr4 = &mpcb->locaddr4[ind];
 		if (skb)
-			tp->mptcp->add_addr4 &= ~(1 << ind);
+			tp->mptcp->add_addr4 &= ~(1U << ind);
 		*size += MPTCP_SUB_LEN_ADD_ADDR4_ALIGN;
 	} else if (unlikely(tp->mptcp->add_addr6) &&
 		   MAX_TCP_OPTION_SPACE - *size >= MPTCP_SUB_LEN_ADD_ADDR6_ALIGN) {
@@ -1502,17 +1569,18 @@ void mptcp_established_options(struct sock *sk, struct sk_buff *skb,
 		opts->mptcp_options |= OPTION_ADD_ADDR;
 		opts->addr6 = &mpcb->locaddr6[ind];
 		if (skb)
-			tp->mptcp->add_addr6 &= ~(1 << ind);
+			tp->mptcp->add_addr6 &= ~(1U << ind);
 		*size += MPTCP_SUB_LEN_ADD_ADDR6_ALIGN;
 	} else if (unlikely(mpcb->remove_addrs) &&
-		   MAX_TCP_OPTION_SPACE - *size >=
-		   mptcp_sub_len_remove_addr_align(mpcb->remove_addrs)) {
+		   MAX_TCP_OPTION_SPACE - *size >= MPTCP_SUB_LEN_REMOVE_ADDR) {
 		opts->options |= OPTION_MPTCP;
 		opts->mptcp_options |= OPTION_REMOVE_ADDR;
-		opts->remove_addrs = mpcb->remove_addrs;
+		opts->remove_addrs = mptcp_remove_addrs_fit(mpcb->remove_addrs,
+							    MAX_TCP_OPTION_SPACE - *size);
 		*size += mptcp_sub_len_remove_addr_align(opts->remove_addrs);
+		/* The others go with the next segments */
 		if (skb)
-			mpcb->remove_addrs = 0;
+			mpcb->remove_addrs &= ~opts->remove_addrs;
 	} else if (!(opts->mptcp_options & OPTION_MP_CAPABLE) &&
 		   !(opts->mptcp_options & OPTION_MP_JOIN) &&
 		   ((unlikely(tp->mptcp->add_addr6) &&
@@ -1636,8 +1704,10 @@ void mptcp_options_write(__be32 *ptr, struct tcp_sock *tp,
 		mprem->rsv = 0;
 		addrs_id = &mprem->addrs_id;
 
-		mptcp_for_each_bit_set(opts->remove_addrs, id)
-			*(addrs_id++) = id;
+		for (id = 0; id < sizeof(opts->remove_addrs) * 8; id++) {
+			if (opts->remove_addrs & (1ULL << id))
+				*(addrs_id++) = id;
+		}
 
 		/* Fill the rest with NOP's */
 		if (len_align > len) {
@@ -1716,47 +1786,6 @@ void mptcp_options_write(__be32 *ptr, struct tcp_sock *tp,
 	}
 }
 
-/* Returns the next segment to be sent from the mptcp meta-queue.
- * (chooses the reinject queue if any segment is waiting in it, otherwise,
- * chooses the normal write queue).
- * Sets *@reinject to 1 if the returned segment comes from the
- * reinject queue. Sets it to 0 if it is the regular send-head of the meta-sk,
- * and sets it to -1 if it is a meta-level retransmission to optimize the
- * receive-buffer.
- */
-struct sk_buff *mptcp_next_segment(struct sock *meta_sk, int *reinject)
-{
-	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
-	struct sk_buff *skb = NULL;
-	if (reinject)
-		*reinject = 0;
-
-	/* If we are in fallback-mode, just take from the meta-send-queue */
-	if (mpcb->infinite_mapping_snd || mpcb->send_infinite_mapping)
-		return tcp_send_head(meta_sk);
-
-	skb = skb_peek(&mpcb->reinject_queue);
-
-	if (skb) {
-		if (reinject)
-			*reinject = 1;
-	} else {
-		skb = tcp_send_head(meta_sk);
-
-		if (!skb && meta_sk->sk_write_pending &&
-		    sk_stream_wspace(meta_sk) < sk_stream_min_wspace(meta_sk)) {
-			struct sock *subsk = get_available_subflow(meta_sk, NULL);
-			if (!subsk)
-				return NULL;
-
-			skb = mptcp_rcv_buf_optimization(subsk, 0);
-			if (skb && reinject)
-				*reinject = -1;
-		}
-	}
-	return skb;
-}
-
 /* Sends the datafin */
 void mptcp_send_fin(struct sock *meta_sk)
 {
@@ -1871,7 +1900,7 @@ void mptcp_ack_retransmit_timer(struct sock *sk)
 
 	skb = alloc_skb(MAX_TCP_HEADER, GFP_ATOMIC);
 	if (skb == NULL) {
-		sk_reset_timer(sk, &tp->mptcp->mptcp_ack_timer,
+		sk_reset_timer(sk, tp->mptcp->mptcp_ack_timer,
 			       jiffies + icsk->icsk_rto);
 		return;
 	}
@@ -1888,7 +1917,7 @@ void mptcp_ack_retransmit_timer(struct sock *sk)
 		 */
 		if (!icsk->icsk_retransmits)
 			icsk->icsk_retransmits = 1;
-		sk_reset_timer(sk, &tp->mptcp->mptcp_ack_timer,
+		sk_reset_timer(sk, tp->mptcp->mptcp_ack_timer,
 			       jiffies + icsk->icsk_rto);
 		return;
 	}
@@ -1896,14 +1925,14 @@ void mptcp_ack_retransmit_timer(struct sock *sk)
 out:
 	icsk->icsk_retransmits++;
 	if (icsk->icsk_retransmits == sysctl_tcp_retries1 + 1) {
-		sk_stop_timer(sk, &tp->mptcp->mptcp_ack_timer);
+		sk_stop_timer(sk, tp->mptcp->mptcp_ack_timer);
 		tcp_send_active_reset(sk, GFP_ATOMIC);
 		mptcp_sub_force_close(sk);
 		return;
 	}
 
 	icsk->icsk_rto = min(icsk->icsk_rto << 1, TCP_RTO_MAX);
-	sk_reset_timer(sk, &tp->mptcp->mptcp_ack_timer,
+	sk_reset_timer(sk, tp->mptcp->mptcp_ack_timer,
 		       jiffies + icsk->icsk_rto);
 }
 
@@ -1915,7 +1944,7 @@ void mptcp_ack_handler(unsigned long data)
 	bh_lock_sock(meta_sk);
 	if (sock_owned_by_user(meta_sk)) {
 		/* Try again later */
-		sk_reset_timer(sk, &tcp_sk(sk)->mptcp->mptcp_ack_timer,
+		sk_reset_timer(sk, tcp_sk(sk)->mptcp->mptcp_ack_timer,
 			       jiffies + (HZ / 20));
 		goto out_unlock;
 	}
@@ -2025,10 +2054,27 @@ static int mptcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 	return err;
 }
 
+/* A retransmission at the meta-level goes out as a single MSS on the
+ * subflow (see mptcp_retransmit_skb). Segments built for TSO are split
+ * beforehand at the meta-level, so that the mapping of the subskb matches
+ * the data that gets sent.
+ */
+static int mptcp_retrans_fragment(struct sock *meta_sk, struct sock *sk,
+				  struct sk_buff *skb)
+{
+	unsigned int mss = tcp_current_mss(sk);
+
+	if (skb->len > mss)
+		return mptcp_fragment(meta_sk, skb, mss, mss, 0);
+
+	return 0;
+}
+
 /* Similar to tcp_retransmit_timer
  *
  * The diff is that we have to handle retransmissions of the FAST_CLOSE-message
- * and that we don't have an srtt estimation at the meta-level.
+ * and that the rto is derived from the subflows (see mptcp_set_rto). The
+ * meta-level srtt only estimates the time until data gets DATA_ACKed.
  */
 void mptcp_retransmit_timer(struct sock *meta_sk)
 {
@@ -2078,11 +2124,14 @@ void mptcp_retransmit_timer(struct sock *meta_sk)
 			return;
 		}
 
-		sk = get_available_subflow(meta_sk, tcp_write_queue_head(meta_sk));
+		sk = mptcp_get_subflow(meta_sk, tcp_write_queue_head(meta_sk));
+		trace_mptcp_retransmit_timer(meta_sk, sk);
 		if (!sk)
 			goto out_reset_timer;
 
 		skb = tcp_write_queue_head(meta_sk);
+		if (mptcp_retrans_fragment(meta_sk, sk, skb))
+			goto out_reset_timer;
 		subskb = mptcp_skb_entail(sk, &skb, -1);
 		if (!subskb)
 			goto out_reset_timer;
@@ -2101,11 +2150,14 @@ void mptcp_retransmit_timer(struct sock *meta_sk)
 	if (meta_icsk->icsk_retransmits == 0)
 		NET_INC_STATS_BH(sock_net(meta_sk), LINUX_MIB_TCPTIMEOUTS);
 
-	sk = get_available_subflow(meta_sk, tcp_write_queue_head(meta_sk));
+	sk = mptcp_get_subflow(meta_sk, tcp_write_queue_head(meta_sk));
+	trace_mptcp_retransmit_timer(meta_sk, sk);
 	if (!sk)
 		goto out_backoff;
 
 	skb = tcp_write_queue_head(meta_sk);
+	if (mptcp_retrans_fragment(meta_sk, sk, skb))
+		goto out_reset_timer;
 	subskb = mptcp_skb_entail(sk, &skb, -1);
 	if (!subskb)
 		goto out_reset_timer;
@@ -2161,7 +2213,7 @@ out_reset_timer:
 	    meta_icsk->icsk_retransmits <= TCP_THIN_LINEAR_RETRIES) {
 		meta_icsk->icsk_backoff = 0;
 		/* We cannot do the same as in tcp_write_timer because the
-		 * srtt is not set here.
+		 * rto is not derived from the meta-level srtt.
 		 */
 		mptcp_set_rto(meta_sk);
 	} else {
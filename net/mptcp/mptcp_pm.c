@@ -28,13 +28,17 @@
  */
 
 #include <linux/module.h>
+#include <linux/cryptohash.h>
 #include <linux/netdevice.h>
 #include <linux/inetdevice.h>
 #include <linux/list.h>
 #include <linux/tcp.h>
 #include <linux/workqueue.h>
 #include <linux/proc_fs.h>	/* Needed by proc_net_fops_create */
+#include <linux/bootmem.h>
+#include <linux/vmalloc.h>
 #include <net/inet_sock.h>
+#include <net/netns/generic.h>
 #include <net/tcp.h>
 #include <net/mptcp.h>
 #include <net/mptcp_v4.h>
@@ -48,12 +52,46 @@
 #include <net/addrconf.h>
 #endif
 
+/* The token hashtable is sized at boot-time, as tcp_hashinfo.ehash, either
+ * from the amount of memory or from the "mptcp_thash_entries=" parameter.
+ *
+ * A bucket holds the meta-sockets and the MP_CAPABLE request-socks whose
+ * token falls into it. Both chains are protected by the same lock out of
+ * mptcp_tk_locks, so that a single lock ensures the uniqueness of a token.
+ * Lookups (e.g., for an MP_JOIN) are lockless, under RCU.
+ */
+struct mptcp_tk_bucket {
+	struct hlist_nulls_head	meta;	/* Meta-sockets */
+	struct hlist_nulls_head	reqsk;	/* Request-socks, to avoid collisions */
+};
+
+static struct mptcp_tk_bucket *tk_hashtable __read_mostly;
+static unsigned int mptcp_tk_hmask __read_mostly;
+static spinlock_t *mptcp_tk_locks __read_mostly;
+static unsigned int mptcp_tk_lmask __read_mostly;
+
+static __initdata unsigned long mptcp_thash_entries;
+
+/* Secret of the keys of the MP_CAPABLE handshakes answered with a syncookie */
+static u32 mptcp_cookie_secret[6] __read_mostly;
+static int __init set_mptcp_thash_entries(char *str)
+{
+	if (!str)
+		return 0;
+	mptcp_thash_entries = simple_strtoul(str, &str, 0);
+	return 1;
+}
+__setup("mptcp_thash_entries=", set_mptcp_thash_entries);
+
 static inline u32 mptcp_hash_tk(u32 token)
 {
-	return token % MPTCP_HASH_SIZE;
+	return token & mptcp_tk_hmask;
 }
 
-static struct hlist_nulls_head tk_hashtable[MPTCP_HASH_SIZE];
+static inline spinlock_t *mptcp_tk_lock(u32 hash)
+{
+	return &mptcp_tk_locks[hash & mptcp_tk_lmask];
+}
 
 /* This second hashtable is needed to retrieve request socks
  * created as a result of a join request. While the SYN contains
@@ -61,12 +99,61 @@ static struct hlist_nulls_head tk_hashtable[MPTCP_HASH_SIZE];
  * to retrieve the mpcb.
  */
 struct list_head mptcp_reqsk_htb[MPTCP_HASH_SIZE];
-spinlock_t mptcp_reqsk_hlock;	/* hashtable protection */
+spinlock_t mptcp_reqsk_hlock[MPTCP_HASH_SIZE];	/* per-bucket lock */
+
+/* Per-netns state of the path-manager.
+ *
+ * Address-events are not handled in the notifier-chain, but queued to a
+ * per-netns worker, so that their cost does not depend on the number of
+ * connections. An event on an already queued address replaces the pending
+ * one. The worker finds the connections using a vanished address through
+ * the address-index, and walks the list of connections of the netns only
+ * once per batch for the other events.
+ */
+#define MPTCP_PM_ADDR_HSIZE	16
+
+struct mptcp_pm_net {
+	spinlock_t		lock;		/* Protects everything below */
+	struct list_head	conns;		/* mpcb->pm_list */
+	struct hlist_head	addr_hash[MPTCP_PM_ADDR_HSIZE];
+	struct list_head	events;		/* Pending mptcp_addr_events */
+	unsigned int		resync:1;	/* Failed to queue an event */
+	struct work_struct	work;
+};
+
+static int mptcp_pm_net_id __read_mostly;
 
-/* The following hash table is used to avoid collision of token */
-static struct hlist_nulls_head mptcp_reqsk_tk_htb[MPTCP_HASH_SIZE];
-spinlock_t mptcp_tk_hashlock;	/* hashtable protection */
+static inline struct mptcp_pm_net *mptcp_pm_net(struct net *net)
+{
+	return net_generic(net, mptcp_pm_net_id);
+}
+
+static inline u32 mptcp_pm_addr_hashfn(sa_family_t family, const void *addr)
+{
+	u32 hash;
+
+	if (family == AF_INET)
+		hash = jhash_1word(((struct in_addr *)addr)->s_addr, 0);
+	else
+		hash = jhash2(((struct in6_addr *)addr)->s6_addr32, 4, 0);
+
+	return hash & (MPTCP_PM_ADDR_HSIZE - 1);
+}
+
+static int mptcp_pm_addr_equal(sa_family_t family,
+			       const union mptcp_pm_inet_addr *a,
+			       const void *addr)
+{
+	if (family == AF_INET)
+		return a->in.s_addr == ((struct in_addr *)addr)->s_addr;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	return ipv6_addr_equal(&a->in6, addr);
+#else
+	return 0;
+#endif
+}
 
+/* Must be called with the bucket-lock held */
 static int mptcp_reqsk_find_tk(u32 token)
 {
 	u32 hash = mptcp_hash_tk(token);
@@ -74,7 +161,7 @@ static int mptcp_reqsk_find_tk(u32 token)
 	const struct hlist_nulls_node *node;
 
 	hlist_nulls_for_each_entry_rcu(mtreqsk, node,
-				       &mptcp_reqsk_tk_htb[hash], collide_tk) {
+				       &tk_hashtable[hash].reqsk, collide_tk) {
 		if (token == mtreqsk->mptcp_loc_token)
 			return 1;
 	}
@@ -86,38 +173,72 @@ static void mptcp_reqsk_insert_tk(struct request_sock *reqsk, u32 token)
 	u32 hash = mptcp_hash_tk(token);
 
 	hlist_nulls_add_head_rcu(&mptcp_rsk(reqsk)->collide_tk,
-				 &mptcp_reqsk_tk_htb[hash]);
+				 &tk_hashtable[hash].reqsk);
 }
 
+/* Must be called with bottom-halves disabled */
 void mptcp_reqsk_remove_tk(struct request_sock *reqsk)
 {
-	rcu_read_lock();
-	spin_lock(&mptcp_tk_hashlock);
-	hlist_nulls_del_rcu(&mptcp_rsk(reqsk)->collide_tk);
-	spin_unlock(&mptcp_tk_hashlock);
-	rcu_read_unlock();
+	spinlock_t *lock = mptcp_tk_lock(mptcp_hash_tk(mptcp_rsk(reqsk)->mptcp_loc_token));
+
+	spin_lock(lock);
+	hlist_nulls_del_init_rcu(&mptcp_rsk(reqsk)->collide_tk);
+	spin_unlock(lock);
 }
 
-void __mptcp_hash_insert(struct tcp_sock *meta_tp, u32 token)
+/* Must be called with the bucket-lock held */
+static void __mptcp_hash_insert(struct tcp_sock *meta_tp, u32 token)
 {
 	u32 hash = mptcp_hash_tk(token);
-	hlist_nulls_add_head_rcu(&meta_tp->tk_table, &tk_hashtable[hash]);
+	hlist_nulls_add_head_rcu(&meta_tp->tk_table, &tk_hashtable[hash].meta);
 	meta_tp->inside_tk_table = 1;
 }
 
+/* Must be called with bottom-halves disabled */
+void mptcp_hash_insert(struct tcp_sock *meta_tp, u32 token)
+{
+	spinlock_t *lock = mptcp_tk_lock(mptcp_hash_tk(token));
+
+	spin_lock(lock);
+	__mptcp_hash_insert(meta_tp, token);
+	spin_unlock(lock);
+}
+
+/* Must be called with the bucket-lock held */
 static int mptcp_find_token(u32 token)
 {
 	u32 hash = mptcp_hash_tk(token);
 	struct tcp_sock *meta_tp;
 	const struct hlist_nulls_node *node;
 
-	hlist_nulls_for_each_entry_rcu(meta_tp, node, &tk_hashtable[hash], tk_table) {
+	hlist_nulls_for_each_entry_rcu(meta_tp, node, &tk_hashtable[hash].meta,
+				       tk_table) {
 		if (token == meta_tp->mptcp_loc_token)
 			return 1;
 	}
 	return 0;
 }
 
+/* Generates a new key and its token. Returns with the lock of the token's
+ * bucket held, once the token is neither used by a meta-socket nor by a
+ * request-sock.
+ */
+static spinlock_t *mptcp_new_token(u64 *key, u32 *token, u64 *idsn)
+{
+	spinlock_t *lock;
+
+	while (1) {
+		get_random_bytes(key, sizeof(*key));
+		mptcp_key_sha1(*key, token, idsn);
+
+		lock = mptcp_tk_lock(mptcp_hash_tk(*token));
+		spin_lock(lock);
+		if (!mptcp_reqsk_find_tk(*token) && !mptcp_find_token(*token))
+			return lock;
+		spin_unlock(lock);
+	}
+}
+
 /* New MPTCP-connection request, prepare a new token for the meta-socket that
  * will be created in mptcp_check_req_master(), and store the received token.
  */
@@ -126,42 +247,120 @@ void mptcp_reqsk_new_mptcp(struct request_sock *req,
 			   const struct mptcp_options_received *mopt)
 {
 	struct mptcp_request_sock *mtreq;
+	spinlock_t *lock;
 	mtreq = mptcp_rsk(req);
 
 	tcp_rsk(req)->saw_mpc = 1;
 
 	rcu_read_lock();
-	spin_lock(&mptcp_tk_hashlock);
-	do {
-		get_random_bytes(&mtreq->mptcp_loc_key,
-				 sizeof(mtreq->mptcp_loc_key));
-		mptcp_key_sha1(mtreq->mptcp_loc_key,
-			       &mtreq->mptcp_loc_token, NULL);
-	} while (mptcp_reqsk_find_tk(mtreq->mptcp_loc_token) ||
-		 mptcp_find_token(mtreq->mptcp_loc_token));
-
+	lock = mptcp_new_token(&mtreq->mptcp_loc_key, &mtreq->mptcp_loc_token,
+			       NULL);
 	mptcp_reqsk_insert_tk(req, mtreq->mptcp_loc_token);
-	spin_unlock(&mptcp_tk_hashlock);
+	spin_unlock(lock);
 	rcu_read_unlock();
 	mtreq->mptcp_rem_key = mopt->mptcp_rem_key;
 }
 
+/* Our key of an MP_CAPABLE handshake answered with a syncookie. It is derived
+ * from the cookie and the 4-tuple of skb (the SYN or the third ACK), so that
+ * nothing has to be stored until the third ACK echoes it.
+ */
+static u64 mptcp_cookie_key(const struct sk_buff *skb, u32 cookie)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+	u32 workspace[SHA_WORKSPACE_WORDS];
+	u32 hash[SHA_DIGEST_WORDS];
+	u32 input[16];
+
+	memset(input, 0, sizeof(input));
+	if (ip_hdr(skb)->version == 4) {
+		input[0] = (__force u32)ip_hdr(skb)->saddr;
+		input[1] = (__force u32)ip_hdr(skb)->daddr;
+	}
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	else {
+		memcpy(&input[0], &ipv6_hdr(skb)->saddr, sizeof(struct in6_addr));
+		memcpy(&input[4], &ipv6_hdr(skb)->daddr, sizeof(struct in6_addr));
+	}
+#endif
+	input[8] = ((__force u32)th->source << 16) | (__force u32)th->dest;
+	input[9] = cookie;
+	memcpy(&input[10], mptcp_cookie_secret, sizeof(mptcp_cookie_secret));
+
+	sha_init(hash);
+	sha_transform(hash, (u8 *)input, workspace);
+
+	return ((u64)hash[0] << 32) | hash[1];
+}
+
+/* New MPTCP-connection request, answered with a syncookie. Contrary to
+ * mptcp_reqsk_new_mptcp(), no token is reserved: req is freed once the
+ * SYN/ACK is sent, and mptcp_reqsk_init_cookie() takes over upon the third ACK.
+ */
+void mptcp_reqsk_new_cookie(struct request_sock *req,
+			    const struct mptcp_options_received *mopt,
+			    const struct sk_buff *skb, u32 cookie)
+{
+	struct mptcp_request_sock *mtreq = mptcp_rsk(req);
+
+	tcp_rsk(req)->saw_mpc = 1;
+	mtreq->mptcp_loc_key = mptcp_cookie_key(skb, cookie);
+	mtreq->mptcp_rem_key = mopt->mptcp_rem_key;
+}
+
+/* Third ACK of an MP_CAPABLE handshake answered with a syncookie. It carries
+ * both keys and the checksum-flag. Our key must be the one derived from the
+ * cookie, and its token must not be in use - otherwise, the connection falls
+ * back to regular TCP.
+ *
+ * Returns 0 if req is an MPTCP-request, with its token reserved.
+ */
+int mptcp_reqsk_init_cookie(struct request_sock *req,
+			    const struct mptcp_options_received *mopt,
+			    const struct sk_buff *skb)
+{
+	struct mptcp_request_sock *mtreq = mptcp_rsk(req);
+	u32 cookie = ntohl(tcp_hdr(skb)->ack_seq) - 1;
+	spinlock_t *lock;
+	int ret = -1;
+
+	mtreq->mpcb = NULL;
+	mtreq->collide_tk.pprev = NULL;
+	mtreq->dss_csum = mopt->dss_csum;
+	mtreq->mptcp_rem_key = mopt->mptcp_rem_key;
+	mtreq->mptcp_loc_key = mptcp_cookie_key(skb, cookie);
+
+	if (mopt->mptcp_echo_key != mtreq->mptcp_loc_key) {
+		mptcp_debug("%s: wrong key echoed in the third ACK\n", __func__);
+		return -1;
+	}
+
+	mptcp_key_sha1(mtreq->mptcp_loc_key, &mtreq->mptcp_loc_token, NULL);
+
+	rcu_read_lock();
+	lock = mptcp_tk_lock(mptcp_hash_tk(mtreq->mptcp_loc_token));
+	spin_lock(lock);
+	if (!mptcp_reqsk_find_tk(mtreq->mptcp_loc_token) &&
+	    !mptcp_find_token(mtreq->mptcp_loc_token)) {
+		mptcp_reqsk_insert_tk(req, mtreq->mptcp_loc_token);
+		tcp_rsk(req)->saw_mpc = 1;
+		ret = 0;
+	}
+	spin_unlock(lock);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 void mptcp_connect_init(struct tcp_sock *tp)
 {
+	spinlock_t *lock;
 	u64 idsn;
 
 	rcu_read_lock_bh();
-	spin_lock(&mptcp_tk_hashlock);
-	do {
-		get_random_bytes(&tp->mptcp_loc_key,
-				 sizeof(tp->mptcp_loc_key));
-		mptcp_key_sha1(tp->mptcp_loc_key,
-			       &tp->mptcp_loc_token, &idsn);
-	} while (mptcp_reqsk_find_tk(tp->mptcp_loc_token) ||
-		 mptcp_find_token(tp->mptcp_loc_token));
-
+	lock = mptcp_new_token(&tp->mptcp_loc_key, &tp->mptcp_loc_token, &idsn);
 	__mptcp_hash_insert(tp, tp->mptcp_loc_token);
-	spin_unlock(&mptcp_tk_hashlock);
+	spin_unlock(lock);
 	rcu_read_unlock_bh();
 }
 
@@ -178,38 +377,198 @@ struct sock *mptcp_hash_find(struct net *net, u32 token)
 	struct hlist_nulls_node *node;
 
 	rcu_read_lock();
-	hlist_nulls_for_each_entry_rcu(meta_tp, node, &tk_hashtable[hash],
+begin:
+	hlist_nulls_for_each_entry_rcu(meta_tp, node, &tk_hashtable[hash].meta,
 				       tk_table) {
 		meta_sk = (struct sock *)meta_tp;
-		if (token == meta_tp->mptcp_loc_token &&
-		    net_eq(net, sock_net(meta_sk)) &&
-		    atomic_inc_not_zero(&meta_sk->sk_refcnt))
-			break;
-		meta_sk = NULL;
+		if (token != meta_tp->mptcp_loc_token ||
+		    !net_eq(net, sock_net(meta_sk)))
+			continue;
+
+		if (unlikely(!atomic_inc_not_zero(&meta_sk->sk_refcnt)))
+			continue;
+
+		/* tcp-socks are SLAB_DESTROY_BY_RCU. The meta-sk may have been
+		 * reused in the meantime.
+		 */
+		if (unlikely(token != meta_tp->mptcp_loc_token ||
+			     !net_eq(net, sock_net(meta_sk)))) {
+			sock_put(meta_sk);
+			goto begin;
+		}
+		goto found;
 	}
+	/* If the nulls value we got at the end of this lookup is not the
+	 * expected one, we must restart the lookup. A meta-sk may have been
+	 * moved to another chain.
+	 */
+	if (get_nulls_value(node) != hash)
+		goto begin;
+	meta_sk = NULL;
+found:
 	rcu_read_unlock();
 	return meta_sk;
 }
 
 void mptcp_hash_remove_bh(struct tcp_sock *meta_tp)
 {
+	spinlock_t *lock = mptcp_tk_lock(mptcp_hash_tk(meta_tp->mptcp_loc_token));
+
 	/* remove from the token hashtable */
-	rcu_read_lock_bh();
-	spin_lock(&mptcp_tk_hashlock);
-	hlist_nulls_del_rcu(&meta_tp->tk_table);
+	spin_lock_bh(lock);
+	hlist_nulls_del_init_rcu(&meta_tp->tk_table);
 	meta_tp->inside_tk_table = 0;
-	spin_unlock(&mptcp_tk_hashlock);
-	rcu_read_unlock_bh();
+	spin_unlock_bh(lock);
 }
 
 void mptcp_hash_remove(struct tcp_sock *meta_tp)
 {
-	rcu_read_lock();
-	spin_lock(&mptcp_tk_hashlock);
-	hlist_nulls_del_rcu(&meta_tp->tk_table);
+	spinlock_t *lock = mptcp_tk_lock(mptcp_hash_tk(meta_tp->mptcp_loc_token));
+
+	spin_lock(lock);
+	hlist_nulls_del_init_rcu(&meta_tp->tk_table);
 	meta_tp->inside_tk_table = 0;
-	spin_unlock(&mptcp_tk_hashlock);
-	rcu_read_unlock();
+	spin_unlock(lock);
+}
+
+/* The address-arrays of the mpcb start with MPTCP_INIT_ADDR entries,
+ * embedded in the mpcb. If more addresses are needed, they are moved to a
+ * kmalloc'ed array that grows in powers of two up to MPTCP_MAX_ADDR.
+ * Thus, the common case of one or two addresses needs no allocation.
+ *
+ * Pointers inside the arrays are invalidated by a call to this function.
+ */
+int __mptcp_addr_reserve(void **array, void *init, u8 *size, size_t elem_size,
+			 int index)
+{
+	unsigned int new_size;
+	void *new;
+
+	if (index < *size)
+		return 0;
+
+	if (index >= MPTCP_MAX_ADDR)
+		return -ENOSPC;
+
+	new_size = min_t(unsigned int, roundup_pow_of_two(index + 1),
+			 MPTCP_MAX_ADDR);
+
+	if (*array == init) {
+		new = kmalloc(new_size * elem_size, GFP_ATOMIC);
+		if (new)
+			memcpy(new, init, *size * elem_size);
+	} else {
+		new = krealloc(*array, new_size * elem_size, GFP_ATOMIC);
+	}
+	if (!new)
+		return -ENOMEM;
+
+	memset((char *)new + *size * elem_size, 0,
+	       (new_size - *size) * elem_size);
+	*array = new;
+	*size = new_size;
+
+	return 0;
+}
+
+/* Must be called with the per-netns lock held */
+static void mptcp_pm_addr_release(struct mptcp_pm_addr *pa)
+{
+	if (pa == &pa->mpcb->pm_addr0)
+		pa->mpcb = NULL;
+	else
+		kfree(pa);
+}
+
+/* Adds a local address of mpcb to the address-index of its netns */
+int mptcp_pm_addr_index(struct mptcp_cb *mpcb, sa_family_t family,
+			const void *addr)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(sock_net(mpcb->meta_sk));
+	struct mptcp_pm_addr *pa = NULL;
+
+	spin_lock_bh(&pmn->lock);
+	if (!mpcb->pm_addr0.mpcb) {
+		pa = &mpcb->pm_addr0;
+		pa->mpcb = mpcb;
+	}
+	spin_unlock_bh(&pmn->lock);
+
+	if (!pa) {
+		pa = kmalloc(sizeof(*pa), GFP_ATOMIC);
+		if (!pa)
+			return -ENOMEM;
+		pa->mpcb = mpcb;
+	}
+
+	pa->family = family;
+	if (family == AF_INET)
+		pa->addr.in = *(struct in_addr *)addr;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	else
+		ipv6_addr_copy(&pa->addr.in6, addr);
+#endif
+
+	spin_lock_bh(&pmn->lock);
+	hlist_add_head(&pa->hash,
+		       &pmn->addr_hash[mptcp_pm_addr_hashfn(family, addr)]);
+	list_add(&pa->list, &mpcb->pm_addrs);
+	spin_unlock_bh(&pmn->lock);
+
+	return 0;
+}
+
+void mptcp_pm_addr_unindex(struct mptcp_cb *mpcb, sa_family_t family,
+			   const void *addr)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(sock_net(mpcb->meta_sk));
+	struct mptcp_pm_addr *pa;
+
+	spin_lock_bh(&pmn->lock);
+	list_for_each_entry(pa, &mpcb->pm_addrs, list) {
+		if (pa->family == family &&
+		    mptcp_pm_addr_equal(family, &pa->addr, addr)) {
+			hlist_del(&pa->hash);
+			list_del(&pa->list);
+			mptcp_pm_addr_release(pa);
+			break;
+		}
+	}
+	spin_unlock_bh(&pmn->lock);
+}
+
+/* Makes the connection visible to the address-events of its netns */
+void mptcp_pm_conn_add(struct mptcp_cb *mpcb)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(sock_net(mpcb->meta_sk));
+
+	spin_lock_bh(&pmn->lock);
+	list_add_tail(&mpcb->pm_list, &pmn->conns);
+	spin_unlock_bh(&pmn->lock);
+}
+
+void mptcp_addr_free(struct mptcp_cb *mpcb)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(sock_net(mpcb->meta_sk));
+	struct mptcp_pm_addr *pa, *tmp;
+
+	spin_lock_bh(&pmn->lock);
+	list_del_init(&mpcb->pm_list);
+	list_for_each_entry_safe(pa, tmp, &mpcb->pm_addrs, list) {
+		hlist_del(&pa->hash);
+		list_del(&pa->list);
+		mptcp_pm_addr_release(pa);
+	}
+	spin_unlock_bh(&pmn->lock);
+
+	if (mpcb->locaddr4 != mpcb->locaddr4_init)
+		kfree(mpcb->locaddr4);
+	if (mpcb->locaddr6 != mpcb->locaddr6_init)
+		kfree(mpcb->locaddr6);
+	if (mpcb->remaddr4 != mpcb->remaddr4_init)
+		kfree(mpcb->remaddr4);
+	if (mpcb->remaddr6 != mpcb->remaddr6_init)
+		kfree(mpcb->remaddr6);
 }
 
 u8 mptcp_get_loc_addrid(struct mptcp_cb *mpcb, struct sock *sk)
@@ -256,6 +615,10 @@ void mptcp_set_addresses(struct sock *meta_sk)
 	if (sysctl_mptcp_ndiffports > 1)
 		return;
 
+	/* The netlink path-manager announces the addresses */
+	if (sysctl_mptcp_pm_netlink)
+		return;
+
 	rcu_read_lock();
 	read_lock_bh(&dev_base_lock);
 
@@ -292,7 +655,8 @@ void mptcp_set_addresses(struct sock *meta_sk)
 
 				i = __mptcp_find_free_index(mpcb->loc4_bits, -1,
 							    mpcb->next_v4_index);
-				if (i < 0) {
+				if (i < 0 || mptcp_addr_reserve(mpcb, locaddr4, i) ||
+				    mptcp_pm_addr_index(mpcb, AF_INET, &ifa_address)) {
 					mptcp_debug("%s: At max num of local addresses: %d --- not adding address: %pI4\n",
 						    __func__, MPTCP_MAX_ADDR,
 						    &ifa_address);
@@ -303,7 +667,7 @@ void mptcp_set_addresses(struct sock *meta_sk)
 				mpcb->locaddr4[i].id = i;
 				mpcb->locaddr4[i].low_prio = (dev->flags & IFF_MPBACKUP) ?
 								1 : 0;
-				mpcb->loc4_bits |= (1 << i);
+				mpcb->loc4_bits |= (1U << i);
 				mpcb->next_v4_index = i + 1;
 				mptcp_v4_send_add_addr(i, mpcb);
 			}
@@ -333,7 +697,8 @@ cont_ipv6:
 
 				i = __mptcp_find_free_index(mpcb->loc6_bits, -1,
 							    mpcb->next_v6_index);
-				if (i < 0) {
+				if (i < 0 || mptcp_addr_reserve(mpcb, locaddr6, i) ||
+				    mptcp_pm_addr_index(mpcb, AF_INET6, &ifa6->addr)) {
 					mptcp_debug("%s: At max num of local addresses: %d --- not adding address: %pI6\n",
 						    __func__, MPTCP_MAX_ADDR,
 						    &ifa6->addr);
@@ -346,7 +711,7 @@ cont_ipv6:
 				mpcb->locaddr6[i].id = i + MPTCP_MAX_ADDR;
 				mpcb->locaddr6[i].low_prio = (dev->flags & IFF_MPBACKUP) ?
 					1 : 0;
-				mpcb->loc6_bits |= (1 << i);
+				mpcb->loc6_bits |= (1U << i);
 				mpcb->next_v6_index = i + 1;
 				mptcp_v6_send_add_addr(i, mpcb);
 			}
@@ -561,6 +926,7 @@ int mptcp_do_join_short(struct sk_buff *skb, struct mptcp_options_received *mopt
 	return 0;
 }
 
+/* Retries the subflows that failed for lack of a route, all at once */
 void mptcp_retry_subflow_worker(struct work_struct *work)
 {
 	struct delayed_work *delayed_work =
@@ -568,45 +934,31 @@ void mptcp_retry_subflow_worker(struct work_struct *work)
 	struct mptcp_cb *mpcb =
 		container_of(delayed_work, struct mptcp_cb, subflow_retry_work);
 	struct sock *meta_sk = mpcb->meta_sk;
-	int iter = 0, i;
+	int i, j;
 
-next_subflow:
-	if (iter) {
-		release_sock(meta_sk);
-		mutex_unlock(&mpcb->mutex);
-
-		yield();
-	}
 	mutex_lock(&mpcb->mutex);
 	lock_sock_nested(meta_sk, SINGLE_DEPTH_NESTING);
 
-	iter++;
-
 	if (sock_flag(meta_sk, SOCK_DEAD))
 		goto exit;
 
 	mptcp_for_each_bit_set(mpcb->rem4_bits, i) {
 		struct mptcp_rem4 *rem = &mpcb->remaddr4[i];
-		/* Do we need to retry establishing a subflow ? */
-		if (rem->retry_bitfield) {
-			int i = mptcp_find_free_index(~rem->retry_bitfield);
-			mptcp_init4_subsockets(meta_sk, &mpcb->locaddr4[i], rem);
-			rem->retry_bitfield &= ~(1 << mpcb->locaddr4[i].id);
-			goto next_subflow;
-		}
+		u32 retry_bits = rem->retry_bitfield & mpcb->loc4_bits;
+
+		rem->retry_bitfield = 0;
+		mptcp_for_each_bit_set(retry_bits, j)
+			mptcp_init4_subsockets(meta_sk, &mpcb->locaddr4[j], rem);
 	}
 
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	mptcp_for_each_bit_set(mpcb->rem6_bits, i) {
 		struct mptcp_rem6 *rem = &mpcb->remaddr6[i];
+		u32 retry_bits = rem->retry_bitfield & mpcb->loc6_bits;
 
-		/* Do we need to retry establishing a subflow ? */
-		if (rem->retry_bitfield) {
-			int i = mptcp_find_free_index(~rem->retry_bitfield);
-			mptcp_init6_subsockets(meta_sk, &mpcb->locaddr6[i], rem);
-			rem->retry_bitfield &= ~(1 << mpcb->locaddr6[i].id);
-			goto next_subflow;
-		}
+		rem->retry_bitfield = 0;
+		mptcp_for_each_bit_set(retry_bits, j)
+			mptcp_init6_subsockets(meta_sk, &mpcb->locaddr6[j], rem);
 	}
 #endif
 
@@ -619,34 +971,26 @@ exit:
 /**
  * Create all new subflows, by doing calls to mptcp_initX_subsockets
  *
- * This function uses a goto next_subflow, to allow releasing the lock between
- * new subflows and giving other processes a chance to do some work on the
- * socket and potentially finishing the communication.
+ * The connects are non-blocking, thus all the SYNs of the MP_JOINs are sent
+ * in a single pass. Their retransmissions are then driven by the SYN-timer
+ * of each subflow. Only the subflows that could not be started for lack of
+ * a route are retried later on by mptcp_retry_subflow_worker.
  **/
 void mptcp_create_subflow_worker(struct work_struct *work)
 {
 	struct mptcp_cb *mpcb = container_of(work, struct mptcp_cb, subflow_work);
 	struct sock *meta_sk = mpcb->meta_sk;
-	int iter = 0, retry = 0;
-	int i;
+	int iter, retry = 0;
+	int i, j;
 
-next_subflow:
-	if (iter) {
-		release_sock(meta_sk);
-		mutex_unlock(&mpcb->mutex);
-
-		yield();
-	}
 	mutex_lock(&mpcb->mutex);
 	lock_sock_nested(meta_sk, SINGLE_DEPTH_NESTING);
 
-	iter++;
-
 	if (sock_flag(meta_sk, SOCK_DEAD))
 		goto exit;
 
-	if (sysctl_mptcp_ndiffports > iter &&
-	    sysctl_mptcp_ndiffports > mpcb->cnt_subflows) {
+	for (iter = 1; sysctl_mptcp_ndiffports > iter &&
+		       sysctl_mptcp_ndiffports > mpcb->cnt_subflows; iter++) {
 		if (meta_sk->sk_family == AF_INET ||
 		    mptcp_v6_is_v4_mapped(meta_sk)) {
 			mptcp_init4_subsockets(meta_sk, &mpcb->locaddr4[0],
@@ -657,48 +1001,33 @@ next_subflow:
 					       &mpcb->remaddr6[0]);
 #endif
 		}
-		goto next_subflow;
 	}
 	if (sysctl_mptcp_ndiffports > 1 &&
 	    sysctl_mptcp_ndiffports == mpcb->cnt_subflows)
 		goto exit;
 
 	mptcp_for_each_bit_set(mpcb->rem4_bits, i) {
-		struct mptcp_rem4 *rem;
-		u8 remaining_bits;
-
-		rem = &mpcb->remaddr4[i];
-		remaining_bits = ~(rem->bitfield) & mpcb->loc4_bits;
+		struct mptcp_rem4 *rem = &mpcb->remaddr4[i];
+		u32 remaining_bits = ~(rem->bitfield) & mpcb->loc4_bits;
 
-		/* Are there still combinations to handle? */
-		if (remaining_bits) {
-			int i = mptcp_find_free_index(~remaining_bits);
+		mptcp_for_each_bit_set(remaining_bits, j) {
 			/* If a route is not yet available then retry once */
-			if (mptcp_init4_subsockets(meta_sk, &mpcb->locaddr4[i],
+			if (mptcp_init4_subsockets(meta_sk, &mpcb->locaddr4[j],
 						   rem) == -ENETUNREACH)
-				retry = rem->retry_bitfield |=
-					(1 << mpcb->locaddr4[i].id);
-			goto next_subflow;
+				retry = rem->retry_bitfield |= (1U << j);
 		}
 	}
 
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	mptcp_for_each_bit_set(mpcb->rem6_bits, i) {
-		struct mptcp_rem6 *rem;
-		u8 remaining_bits;
-
-		rem = &mpcb->remaddr6[i];
-		remaining_bits = ~(rem->bitfield) & mpcb->loc6_bits;
+		struct mptcp_rem6 *rem = &mpcb->remaddr6[i];
+		u32 remaining_bits = ~(rem->bitfield) & mpcb->loc6_bits;
 
-		/* Are there still combinations to handle? */
-		if (remaining_bits) {
-			int i = mptcp_find_free_index(~remaining_bits);
+		mptcp_for_each_bit_set(remaining_bits, j) {
 			/* If a route is not yet available then retry once */
-			if (mptcp_init6_subsockets(meta_sk, &mpcb->locaddr6[i],
+			if (mptcp_init6_subsockets(meta_sk, &mpcb->locaddr6[j],
 						   rem) == -ENETUNREACH)
-				retry = rem->retry_bitfield |=
-					(1 << mpcb->locaddr6[i].id);
-			goto next_subflow;
+				retry = rem->retry_bitfield |= (1U << j);
 		}
 	}
 #endif
@@ -722,7 +1051,8 @@ void mptcp_create_subflows(struct sock *meta_sk)
 	if ((mpcb->master_sk &&
 	     !tcp_sk(mpcb->master_sk)->mptcp->fully_established) ||
 	    mpcb->infinite_mapping_snd || mpcb->infinite_mapping_rcv ||
-	    mpcb->server_side || sock_flag(meta_sk, SOCK_DEAD))
+	    mpcb->server_side || sock_flag(meta_sk, SOCK_DEAD) ||
+	    sysctl_mptcp_pm_netlink)
 		return;
 
 	if (!work_pending(&mpcb->subflow_work)) {
@@ -770,9 +1100,10 @@ void mptcp_address_worker(struct work_struct *work)
 			goto cont_ipv6;
 
 		for (ifa = in_dev->ifa_list; ifa; ifa = ifa->ifa_next) {
+			struct mptcp_addr_event ev;
 			unsigned long event;
 
-			if (!netif_running(in_dev->dev)) {
+			if (!netif_running(dev)) {
 				event = NETDEV_DOWN;
 			} else {
 				/* If it's up, it may have been changed or came up.
@@ -782,7 +1113,8 @@ void mptcp_address_worker(struct work_struct *work)
 				event = NETDEV_CHANGE;
 			}
 
-			mptcp_pm_addr4_event_handler(ifa, event, mpcb);
+			if (!mptcp_v4_fill_addr_event(ifa, event, &ev))
+				mptcp_pm_addr4_event_handler(&ev, mpcb);
 		}
 cont_ipv6:
 ; /* This ; is necessary to fix build-errors when IPv6 is disabled */
@@ -792,19 +1124,21 @@ cont_ipv6:
 
 		read_lock(&in6_dev->lock);
 		list_for_each_entry(ifa6, &in6_dev->addr_list, if_list) {
+			struct mptcp_addr_event ev;
 			unsigned long event;
 
-			if (!netif_running(in_dev->dev)) {
+			if (!netif_running(dev)) {
 				event = NETDEV_DOWN;
 			} else {
 				/* If it's up, it may have been changed or came up.
 				 * We set NETDEV_CHANGE, to take the good
-				 * code-path in mptcp_pm_addr4_event_handler
+				 * code-path in mptcp_pm_addr6_event_handler
 				 */
 				event = NETDEV_CHANGE;
 			}
 
-			mptcp_pm_addr6_event_handler(ifa6, event, mpcb);
+			if (!mptcp_v6_fill_addr_event(ifa6, event, &ev))
+				mptcp_pm_addr6_event_handler(&ev, mpcb);
 		}
 		read_unlock(&in6_dev->lock);
 #endif
@@ -848,9 +1182,10 @@ cont_ipv6:
 		}
 
 		/* Now, remove the address from the local ones */
-		mpcb->loc4_bits &= ~(1 << i);
+		mptcp_pm_addr_unindex(mpcb, AF_INET, &mpcb->locaddr4[i].addr);
+		mpcb->loc4_bits &= ~(1U << i);
 
-		mpcb->remove_addrs |= (1 << mpcb->locaddr4[i].id);
+		mpcb->remove_addrs |= (1ULL << mpcb->locaddr4[i].id);
 		sk = mptcp_select_ack_sock(meta_sk, 0);
 		if (sk)
 			tcp_send_ack(sk);
@@ -901,10 +1236,11 @@ next_loc_addr:
 		}
 
 		/* Now, remove the address from the local ones */
-		mpcb->loc6_bits &= ~(1 << i);
+		mptcp_pm_addr_unindex(mpcb, AF_INET6, &mpcb->locaddr6[i].addr);
+		mpcb->loc6_bits &= ~(1U << i);
 
 		/* Force sending directly the REMOVE_ADDR option */
-		mpcb->remove_addrs |= (1 << mpcb->locaddr6[i].id);
+		mpcb->remove_addrs |= (1ULL << mpcb->locaddr6[i].id);
 		sk = mptcp_select_ack_sock(meta_sk, 0);
 		if (sk)
 			tcp_send_ack(sk);
@@ -935,62 +1271,252 @@ static void mptcp_address_create_worker(struct mptcp_cb *mpcb)
 	}
 }
 
-/**
- * React on IPv4+IPv6-addr add/rem-events
+/* Takes the locks as mptcp_address_worker does. Returns 0 if the
+ * path-manager must leave this connection alone.
  */
-int mptcp_pm_addr_event_handler(unsigned long event, void *ptr, int family)
+static int mptcp_pm_lock_mpcb(struct mptcp_cb *mpcb)
 {
-	struct tcp_sock *meta_tp;
-	int i;
-
-	if (!(event == NETDEV_UP || event == NETDEV_DOWN ||
-	      event == NETDEV_CHANGE))
-		return NOTIFY_DONE;
+	struct sock *meta_sk = mpcb->meta_sk;
 
-	if (sysctl_mptcp_ndiffports > 1)
-		return NOTIFY_DONE;
+	mutex_lock(&mpcb->mutex);
+	lock_sock(meta_sk);
 
-	/* Now we iterate over the mpcb's */
-	for (i = 0; i < MPTCP_HASH_SIZE; i++) {
-		struct hlist_nulls_node *node;
-		rcu_read_lock_bh();
-		hlist_nulls_for_each_entry_rcu(meta_tp, node, &tk_hashtable[i],
-					       tk_table) {
-			struct mptcp_cb *mpcb = meta_tp->mpcb;
-			struct sock *meta_sk = (struct sock *)meta_tp;
+	if (sock_flag(meta_sk, SOCK_DEAD) || !tcp_sk(meta_sk)->mpc ||
+	    mpcb->infinite_mapping_snd || mpcb->infinite_mapping_rcv) {
+		release_sock(meta_sk);
+		mutex_unlock(&mpcb->mutex);
+		return 0;
+	}
 
-			if (unlikely(!atomic_inc_not_zero(&meta_sk->sk_refcnt)))
-				continue;
+	/* The event-handlers are meant to run with bh disabled */
+	local_bh_disable();
+	return 1;
+}
 
-			if (!meta_tp->mpc || !is_meta_sk(meta_sk) ||
-			    mpcb->infinite_mapping_snd ||
-			    mpcb->infinite_mapping_rcv) {
-				sock_put(meta_sk);
-				continue;
-			}
+static void mptcp_pm_unlock_mpcb(struct mptcp_cb *mpcb)
+{
+	local_bh_enable();
+	release_sock(mpcb->meta_sk);
+	mutex_unlock(&mpcb->mutex);
+}
 
-			bh_lock_sock(meta_sk);
-			if (sock_owned_by_user(meta_sk)) {
-				mptcp_address_create_worker(mpcb);
-			} else {
-				if (family == AF_INET)
-					mptcp_pm_addr4_event_handler(
-							(struct in_ifaddr *)ptr, event, mpcb);
+void mptcp_pm_apply_event(const struct mptcp_addr_event *event,
+			  struct mptcp_cb *mpcb)
+{
+	if (event->family == AF_INET)
+		mptcp_pm_addr4_event_handler(event, mpcb);
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
-				else
-					mptcp_pm_addr6_event_handler(
-							(struct inet6_ifaddr *)ptr, event, mpcb);
+	else
+		mptcp_pm_addr6_event_handler(event, mpcb);
 #endif
-			}
+}
 
-			bh_unlock_sock(meta_sk);
-			sock_put(meta_sk);
+/* An address went down - only the connections using it are concerned.
+ * They are detached from the index, so that the lock can be released
+ * while handling them.
+ */
+static void mptcp_pm_event_down(struct mptcp_pm_net *pmn,
+				const struct mptcp_addr_event *event)
+{
+	struct mptcp_addr_event down = *event;
+	struct mptcp_pm_addr *pa, *tmp;
+	struct hlist_node *node, *next;
+	struct hlist_head *head;
+	LIST_HEAD(todo);
+
+	down.code = NETDEV_DOWN;
+	head = &pmn->addr_hash[mptcp_pm_addr_hashfn(event->family, &event->addr)];
+
+	spin_lock_bh(&pmn->lock);
+	hlist_for_each_entry_safe(pa, node, next, head, hash) {
+		if (pa->family != event->family ||
+		    !mptcp_pm_addr_equal(pa->family, &pa->addr, &event->addr))
+			continue;
+
+		/* The mpcb is being destroyed */
+		if (!atomic_inc_not_zero(&pa->mpcb->meta_sk->sk_refcnt))
+			continue;
+
+		hlist_del(&pa->hash);
+		list_move_tail(&pa->list, &todo);
+	}
+	spin_unlock_bh(&pmn->lock);
+
+	list_for_each_entry_safe(pa, tmp, &todo, list) {
+		struct mptcp_cb *mpcb = pa->mpcb;
+		struct sock *meta_sk = mpcb->meta_sk;
+
+		if (mptcp_pm_lock_mpcb(mpcb)) {
+			mptcp_pm_apply_event(&down, mpcb);
+			mptcp_pm_unlock_mpcb(mpcb);
 		}
-		rcu_read_unlock_bh();
+
+		spin_lock_bh(&pmn->lock);
+		list_del(&pa->list);
+		mptcp_pm_addr_release(pa);
+		spin_unlock_bh(&pmn->lock);
+
+		sock_put(meta_sk);
+		cond_resched();
 	}
+}
+
+/* Addresses came up or changed - this may concern any connection of the
+ * netns. All the events of the batch are handled during a single walk.
+ * The reference on the current mpcb's meta-sk keeps it in the list while
+ * the lock is released.
+ */
+static void mptcp_pm_event_walk(struct mptcp_pm_net *pmn,
+				struct list_head *events, int resync)
+{
+	struct sock *prev = NULL;
+	struct mptcp_cb *mpcb;
+
+	spin_lock_bh(&pmn->lock);
+	list_for_each_entry(mpcb, &pmn->conns, pm_list) {
+		struct sock *meta_sk = mpcb->meta_sk;
+
+		if (!atomic_inc_not_zero(&meta_sk->sk_refcnt))
+			continue;
+		spin_unlock_bh(&pmn->lock);
+
+		if (prev)
+			sock_put(prev);
+		prev = meta_sk;
+
+		if (resync) {
+			/* We lost some events - check all the addresses */
+			mptcp_address_create_worker(mpcb);
+		} else if (mptcp_pm_lock_mpcb(mpcb)) {
+			struct mptcp_addr_event *event;
+
+			list_for_each_entry(event, events, list)
+				mptcp_pm_apply_event(event, mpcb);
+			mptcp_pm_unlock_mpcb(mpcb);
+		}
+
+		cond_resched();
+		spin_lock_bh(&pmn->lock);
+	}
+	spin_unlock_bh(&pmn->lock);
+
+	if (prev)
+		sock_put(prev);
+}
+
+static void mptcp_pm_event_worker(struct work_struct *work)
+{
+	struct mptcp_pm_net *pmn = container_of(work, struct mptcp_pm_net, work);
+	struct mptcp_addr_event *event, *tmp;
+	LIST_HEAD(events);
+	int resync;
+
+	spin_lock_bh(&pmn->lock);
+	list_splice_init(&pmn->events, &events);
+	resync = pmn->resync;
+	pmn->resync = 0;
+	spin_unlock_bh(&pmn->lock);
+
+	list_for_each_entry_safe(event, tmp, &events, list) {
+		if (event->code == NETDEV_DOWN || event->down_first)
+			mptcp_pm_event_down(pmn, event);
+
+		if (event->code == NETDEV_DOWN) {
+			list_del(&event->list);
+			kfree(event);
+		}
+	}
+
+	if (!list_empty(&events) || resync)
+		mptcp_pm_event_walk(pmn, &events, resync);
+
+	list_for_each_entry_safe(event, tmp, &events, list)
+		kfree(event);
+}
+
+/**
+ * React on IPv4+IPv6-addr add/rem-events
+ *
+ * Called from the notifier-chains, the event is only queued to the worker
+ * of the netns.
+ */
+int mptcp_pm_addr_event_handler(struct net *net,
+				const struct mptcp_addr_event *event)
+{
+	struct mptcp_pm_net *pmn;
+	struct mptcp_addr_event *ev;
+
+	if (sysctl_mptcp_ndiffports > 1 || sysctl_mptcp_pm_netlink)
+		return NOTIFY_DONE;
+
+	pmn = mptcp_pm_net(net);
+
+	spin_lock_bh(&pmn->lock);
+	list_for_each_entry(ev, &pmn->events, list) {
+		if (ev->family != event->family ||
+		    !mptcp_pm_addr_equal(ev->family, &ev->addr, &event->addr))
+			continue;
+
+		/* Only the last state matters, but the connections using
+		 * the address must know that it went down in-between.
+		 */
+		if (event->code == NETDEV_DOWN)
+			ev->down_first = 0;
+		else if (ev->code == NETDEV_DOWN)
+			ev->down_first = 1;
+		ev->code = event->code;
+		ev->low_prio = event->low_prio;
+		ev->if_running = event->if_running;
+		goto queue;
+	}
+
+	ev = kmalloc(sizeof(*ev), GFP_ATOMIC);
+	if (ev) {
+		*ev = *event;
+		list_add_tail(&ev->list, &pmn->events);
+	} else {
+		pmn->resync = 1;
+	}
+queue:
+	spin_unlock_bh(&pmn->lock);
+
+	queue_work(mptcp_wq, &pmn->work);
 	return NOTIFY_DONE;
 }
 
+static int __net_init mptcp_pm_init_net(struct net *net)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(net);
+	int i;
+
+	spin_lock_init(&pmn->lock);
+	INIT_LIST_HEAD(&pmn->conns);
+	for (i = 0; i < MPTCP_PM_ADDR_HSIZE; i++)
+		INIT_HLIST_HEAD(&pmn->addr_hash[i]);
+	INIT_LIST_HEAD(&pmn->events);
+	INIT_WORK(&pmn->work, mptcp_pm_event_worker);
+
+	return 0;
+}
+
+static void __net_exit mptcp_pm_exit_net(struct net *net)
+{
+	struct mptcp_pm_net *pmn = mptcp_pm_net(net);
+	struct mptcp_addr_event *event, *tmp;
+
+	cancel_work_sync(&pmn->work);
+
+	list_for_each_entry_safe(event, tmp, &pmn->events, list)
+		kfree(event);
+}
+
+static struct pernet_operations mptcp_pm_net_ops = {
+	.init = mptcp_pm_init_net,
+	.exit = mptcp_pm_exit_net,
+	.id = &mptcp_pm_net_id,
+	.size = sizeof(struct mptcp_pm_net),
+};
+
 #ifdef CONFIG_PROC_FS
 
 /* Output /proc/net/mptcp */
@@ -1006,11 +1532,11 @@ static int mptcp_pm_seq_show(struct seq_file *seq, void *v)
 		   "st ns tx_queue rx_queue inode");
 	seq_putc(seq, '\n');
 
-	for (i = 0; i < MPTCP_HASH_SIZE; i++) {
+	for (i = 0; i <= mptcp_tk_hmask; i++) {
 		struct hlist_nulls_node *node;
 		rcu_read_lock_bh();
 		hlist_nulls_for_each_entry_rcu(meta_tp, node,
-					       &tk_hashtable[i], tk_table) {
+					       &tk_hashtable[i].meta, tk_table) {
 			struct mptcp_cb *mpcb = meta_tp->mpcb;
 			struct sock *meta_sk = (struct sock *)meta_tp;
 			struct inet_sock *isk = inet_sk(meta_sk);
@@ -1087,23 +1613,76 @@ static struct pernet_operations mptcp_pm_proc_ops = {
 };
 #endif
 
+static int __init mptcp_tk_locks_alloc(void)
+{
+	unsigned int i, size = 256;
+#if defined(CONFIG_PROVE_LOCKING)
+	unsigned int nr_pcpus = 2;
+#else
+	unsigned int nr_pcpus = num_possible_cpus();
+#endif
+	if (nr_pcpus >= 4)
+		size = 512;
+	if (nr_pcpus >= 8)
+		size = 1024;
+	if (nr_pcpus >= 16)
+		size = 2048;
+	if (nr_pcpus >= 32)
+		size = 4096;
+	size = min(size, mptcp_tk_hmask + 1);
+
+	if (size * sizeof(spinlock_t) > PAGE_SIZE)
+		mptcp_tk_locks = vmalloc(size * sizeof(spinlock_t));
+	else
+		mptcp_tk_locks = kmalloc(size * sizeof(spinlock_t), GFP_KERNEL);
+	if (!mptcp_tk_locks)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		spin_lock_init(&mptcp_tk_locks[i]);
+	mptcp_tk_lmask = size - 1;
+
+	return 0;
+}
+
 /* General initialization of MPTCP_PM */
-int mptcp_pm_init(void)
+int __init mptcp_pm_init(void)
 {
 	int i, ret;
+
+	get_random_bytes(mptcp_cookie_secret, sizeof(mptcp_cookie_secret));
+
+	tk_hashtable = alloc_large_system_hash("MPTCP token",
+					       sizeof(struct mptcp_tk_bucket),
+					       mptcp_thash_entries,
+					       (totalram_pages >= 128 * 1024) ?
+					       13 : 15,
+					       0,
+					       NULL,
+					       &mptcp_tk_hmask,
+					       mptcp_thash_entries ? 0 : 512 * 1024);
+	for (i = 0; i <= mptcp_tk_hmask; i++) {
+		INIT_HLIST_NULLS_HEAD(&tk_hashtable[i].meta, i);
+		INIT_HLIST_NULLS_HEAD(&tk_hashtable[i].reqsk, i);
+	}
+
+	ret = mptcp_tk_locks_alloc();
+	if (ret)
+		return ret;
+
 	for (i = 0; i < MPTCP_HASH_SIZE; i++) {
-		INIT_HLIST_NULLS_HEAD(&tk_hashtable[i], i);
 		INIT_LIST_HEAD(&mptcp_reqsk_htb[i]);
-		INIT_HLIST_NULLS_HEAD(&mptcp_reqsk_tk_htb[i], i);
+		spin_lock_init(&mptcp_reqsk_hlock[i]);
 	}
 
-	spin_lock_init(&mptcp_reqsk_hlock);
-	spin_lock_init(&mptcp_tk_hashlock);
+	ret = register_pernet_subsys(&mptcp_pm_net_ops);
+	if (ret)
+		goto out;
 
 #ifdef CONFIG_PROC_FS
 	ret = register_pernet_subsys(&mptcp_pm_proc_ops);
 	if (ret)
-		goto out;
+		goto mptcp_pm_proc_failed;
 #endif
 
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
@@ -1115,9 +1694,15 @@ int mptcp_pm_init(void)
 	if (ret)
 		goto mptcp_pm_v4_failed;
 
+	ret = mptcp_genl_init();
+	if (ret)
+		goto mptcp_genl_failed;
+
 out:
 	return ret;
 
+mptcp_genl_failed:
+	mptcp_pm_v4_undo();
 mptcp_pm_v4_failed:
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	mptcp_pm_v6_undo();
@@ -1126,12 +1711,16 @@ mptcp_pm_v6_failed:
 #endif
 #ifdef CONFIG_PROC_FS
 	unregister_pernet_subsys(&mptcp_pm_proc_ops);
+
+mptcp_pm_proc_failed:
 #endif
+	unregister_pernet_subsys(&mptcp_pm_net_ops);
 	goto out;
 }
 
 void mptcp_pm_undo(void)
 {
+	mptcp_genl_undo();
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 	mptcp_pm_v6_undo();
 #endif
@@ -1139,4 +1728,5 @@ void mptcp_pm_undo(void)
 #ifdef CONFIG_PROC_FS
 	unregister_pernet_subsys(&mptcp_pm_proc_ops);
 #endif
+	unregister_pernet_subsys(&mptcp_pm_net_ops);
 }
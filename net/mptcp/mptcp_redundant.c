@@ -0,0 +1,251 @@
+/*
+ *	MPTCP implementation - Redundant scheduler
+ *
+ *	Every segment is sent on all the available subflows. New data goes
+ *	first on the subflow with the lowest RTT. The copies on the other
+ *	subflows are opportunistic retransmissions (*reinject = -1) of the
+ *	segments of the meta write-queue, whose path_mask tells on which
+ *	subflows they have already been sent.
+ *
+ *	This trades bandwidth for latency: the fastest path delivers each
+ *	segment, which cuts the tail latency of small transfers over lossy
+ *	links. The backup subflows are only used if no other is established.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+
+#include <net/mptcp.h>
+
+struct redsched_priv {
+	/* The last segment of the meta write-queue sent on the subflow, and
+	 * its data-seq. The segments before it have already been sent on the
+	 * subflow, thus redsched_next_segment resumes its scan from there.
+	 */
+	struct sk_buff	*skb;
+	u32		seq;
+};
+
+static struct redsched_priv *redsched_get_priv(const struct tcp_sock *tp)
+{
+	return (struct redsched_priv *)mptcp_sched_priv(tp);
+}
+
+static inline int redsched_is_backup(const struct tcp_sock *tp)
+{
+	return tp->mptcp->rcv_low_prio || tp->mptcp->low_prio;
+}
+
+/* Should we use the backup subflows? Only if no other one is established */
+static int redsched_use_backup(const struct mptcp_cb *mpcb)
+{
+	struct tcp_sock *tp;
+	int cnt_backups = 0;
+
+	mptcp_for_each_tp(mpcb, tp) {
+		if (redsched_is_backup(tp))
+			cnt_backups++;
+	}
+
+	return mpcb->cnt_established == cnt_backups;
+}
+
+/* The available subflow with the lowest RTT, on which skb has not yet been
+ * sent.
+ */
+static struct sock *redsched_best_subflow(struct mptcp_cb *mpcb,
+					  struct sk_buff *skb, int backup)
+{
+	struct sock *sk, *bestsk = NULL;
+	u32 min_srtt = 0xffffffff;
+
+	mptcp_for_each_sk(mpcb, sk) {
+		struct tcp_sock *tp = tcp_sk(sk);
+
+		if (redsched_is_backup(tp) != backup ||
+		    mptcp_pi_to_flag(tp->mptcp->path_index) &
+		    TCP_SKB_CB(skb)->path_mask ||
+		    !mptcp_is_available(sk, skb))
+			continue;
+
+		if (tp->srtt < min_srtt) {
+			min_srtt = tp->srtt;
+			bestsk = sk;
+		}
+	}
+
+	return bestsk;
+}
+
+/* Path-mask of the subflows skb may be sent on */
+static u64 redsched_active_mask(struct mptcp_cb *mpcb, int backup)
+{
+	struct tcp_sock *tp;
+	u64 mask = 0;
+
+	mptcp_for_each_tp(mpcb, tp) {
+		if (redsched_is_backup(tp) == backup &&
+		    mptcp_sk_can_send((struct sock *)tp) &&
+		    !tp->mptcp->pre_established)
+			mask |= mptcp_pi_to_flag(tp->mptcp->path_index);
+	}
+
+	return mask;
+}
+
+static struct sock *redsched_get_subflow(struct sock *meta_sk,
+					 struct sk_buff *skb)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	int backup;
+
+	if (!skb || mpcb->cnt_subflows == 1 || mptcp_is_data_fin(skb))
+		return mptcp_default_get_subflow(meta_sk, skb);
+
+	backup = redsched_use_backup(mpcb);
+
+	/* Already sent on all the subflows (e.g., a reinjection after a
+	 * subflow failed) - the default scheduler restarts its path-mask.
+	 */
+	if (!(redsched_active_mask(mpcb, backup) & ~TCP_SKB_CB(skb)->path_mask))
+		return mptcp_default_get_subflow(meta_sk, skb);
+
+	return redsched_best_subflow(mpcb, skb, backup);
+}
+
+/* Where to start the scan of the write-queue: at the earliest of the
+ * segments last sent on the available subflows. A segment of the meta
+ * write-queue is only freed once it is DATA_ACKed, thus the cursor is still
+ * valid if snd_una did not go beyond its start.
+ */
+static struct sk_buff *redsched_scan_start(struct sock *meta_sk, u64 avail)
+{
+	struct tcp_sock *meta_tp = tcp_sk(meta_sk);
+	struct sk_buff *start = NULL;
+	struct tcp_sock *tp;
+
+	mptcp_for_each_tp(meta_tp->mpcb, tp) {
+		struct redsched_priv *priv = redsched_get_priv(tp);
+
+		if (!(avail & mptcp_pi_to_flag(tp->mptcp->path_index)))
+			continue;
+
+		if (!priv->skb || after(meta_tp->snd_una, priv->seq))
+			return tcp_write_queue_head(meta_sk);
+
+		if (!start || before(priv->seq, TCP_SKB_CB(start)->seq))
+			start = priv->skb;
+	}
+
+	return start ? : tcp_write_queue_head(meta_sk);
+}
+
+/* Record skb as the last segment sent on the subflow that
+ * redsched_get_subflow is going to select.
+ */
+static void redsched_update_cursor(struct mptcp_cb *mpcb, struct sk_buff *skb,
+				   int backup)
+{
+	struct sock *sk = redsched_best_subflow(mpcb, skb, backup);
+	struct redsched_priv *priv;
+
+	if (!sk)
+		return;
+
+	priv = redsched_get_priv(tcp_sk(sk));
+	priv->skb = skb;
+	priv->seq = TCP_SKB_CB(skb)->seq;
+}
+
+/* The segments of the reinject-queue come first. Then the segments already
+ * sent, but not yet on all the subflows that can currently send, and finally
+ * the new data.
+ *
+ * The scan of the write-queue is skipped if no subflow is available, which
+ * is the common case for a cwnd-limited connection. Otherwise, it starts
+ * from the cursors of the available subflows, not from the head.
+ */
+static struct sk_buff *redsched_next_segment(struct sock *meta_sk,
+					     int *reinject)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sk_buff *skb;
+	u64 avail = 0;
+	struct sock *sk;
+	int backup;
+
+	if (mpcb->infinite_mapping_snd || mpcb->send_infinite_mapping ||
+	    mpcb->cnt_subflows == 1 || !skb_queue_empty(&mpcb->reinject_queue))
+		return mptcp_default_next_segment(meta_sk, reinject);
+
+	backup = redsched_use_backup(mpcb);
+	mptcp_for_each_sk(mpcb, sk) {
+		struct tcp_sock *tp = tcp_sk(sk);
+
+		if (redsched_is_backup(tp) == backup &&
+		    mptcp_is_available(sk, NULL))
+			avail |= mptcp_pi_to_flag(tp->mptcp->path_index);
+	}
+
+	if (!avail)
+		goto new_data;
+
+	skb = redsched_scan_start(meta_sk, avail);
+	if (!skb)
+		goto new_data;
+
+	tcp_for_write_queue_from(skb, meta_sk) {
+		if (skb == tcp_send_head(meta_sk))
+			break;
+
+		if (!(avail & ~TCP_SKB_CB(skb)->path_mask) ||
+		    mptcp_is_data_fin(skb))
+			continue;
+
+		if (redsched_best_subflow(mpcb, skb, backup)) {
+			redsched_update_cursor(mpcb, skb, backup);
+			if (reinject)
+				*reinject = -1;
+			return skb;
+		}
+	}
+
+new_data:
+	skb = tcp_send_head(meta_sk);
+	if (skb && avail && !mptcp_is_data_fin(skb))
+		redsched_update_cursor(mpcb, skb, backup);
+
+	if (reinject)
+		*reinject = 0;
+	return skb;
+}
+
+static struct mptcp_sched_ops mptcp_sched_redundant = {
+	.get_subflow	= redsched_get_subflow,
+	.next_segment	= redsched_next_segment,
+	.name		= "redundant",
+	.owner		= THIS_MODULE,
+};
+
+static int __init redsched_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct redsched_priv) >
+		     MPTCP_SCHED_PRIV_SIZE * sizeof(u32));
+
+	return mptcp_register_scheduler(&mptcp_sched_redundant);
+}
+
+static void __exit redsched_unregister(void)
+{
+	mptcp_unregister_scheduler(&mptcp_sched_redundant);
+}
+
+module_init(redsched_register);
+module_exit(redsched_unregister);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MPTCP redundant scheduler");
@@ -0,0 +1,130 @@
+/*
+ *	MPTCP implementation - Weighted round-robin scheduler
+ *
+ *	New data is spread over the subflows with a smooth weighted
+ *	round-robin. The weight of a subflow is its rate, cwnd/srtt, thus a
+ *	bulk transfer gets split in proportion to the capacity of the paths,
+ *	even when the subflows are not cwnd-limited.
+ *
+ *	Reinjections and DATA_FINs are handled like the default scheduler.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+
+#include <net/mptcp.h>
+
+/* Scaling of the weights. They are capped, so that the sum of the
+ * weights of all the subflows fits into the s32 current_weight.
+ */
+#define RR_WEIGHT_SHIFT	10
+#define RR_WEIGHT_MAX	(1U << 20)
+
+struct rrsched_priv {
+	s32	current_weight;
+};
+
+static struct rrsched_priv *rrsched_get_priv(const struct tcp_sock *tp)
+{
+	return (struct rrsched_priv *)mptcp_sched_priv(tp);
+}
+
+static inline int rrsched_is_backup(const struct tcp_sock *tp)
+{
+	return tp->mptcp->rcv_low_prio || tp->mptcp->low_prio;
+}
+
+/* The rate of the subflow. Without RTT-sample yet, all subflows are equal. */
+static u32 rrsched_weight(const struct tcp_sock *tp)
+{
+	if (!tp->srtt)
+		return 1 << RR_WEIGHT_SHIFT;
+
+	return clamp_t(u64, div_u64((u64)tp->snd_cwnd << (RR_WEIGHT_SHIFT + 3),
+				    tp->srtt), 1, RR_WEIGHT_MAX);
+}
+
+/* Every available subflow gets its weight added to its current weight. The
+ * one with the highest current weight is selected and gets the total of the
+ * weights subtracted. Over time, each subflow is selected in proportion to
+ * its weight, and the selections are interleaved.
+ */
+static struct sock *rrsched_pick(struct mptcp_cb *mpcb, struct sk_buff *skb,
+				 int backup)
+{
+	struct sock *sk, *bestsk = NULL;
+	s32 total = 0;
+
+	mptcp_for_each_sk(mpcb, sk) {
+		struct tcp_sock *tp = tcp_sk(sk);
+		struct rrsched_priv *priv = rrsched_get_priv(tp);
+		u32 weight;
+
+		if (rrsched_is_backup(tp) != backup ||
+		    !mptcp_is_available(sk, skb))
+			continue;
+
+		weight = rrsched_weight(tp);
+		priv->current_weight += weight;
+		total += weight;
+
+		if (!bestsk || priv->current_weight >
+			       rrsched_get_priv(tcp_sk(bestsk))->current_weight)
+			bestsk = sk;
+	}
+
+	if (bestsk)
+		rrsched_get_priv(tcp_sk(bestsk))->current_weight -= total;
+
+	return bestsk;
+}
+
+static struct sock *rrsched_get_subflow(struct sock *meta_sk,
+					struct sk_buff *skb)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct tcp_sock *tp;
+	int cnt_backups = 0;
+
+	if (!skb || mpcb->cnt_subflows == 1 || TCP_SKB_CB(skb)->path_mask ||
+	    mptcp_is_data_fin(skb))
+		return mptcp_default_get_subflow(meta_sk, skb);
+
+	mptcp_for_each_tp(mpcb, tp) {
+		if (rrsched_is_backup(tp))
+			cnt_backups++;
+	}
+
+	/* The backup subflows are only used if no other one is established */
+	return rrsched_pick(mpcb, skb, mpcb->cnt_established == cnt_backups);
+}
+
+static struct mptcp_sched_ops mptcp_sched_rr = {
+	.get_subflow	= rrsched_get_subflow,
+	.next_segment	= mptcp_default_next_segment,
+	.name		= "rr",
+	.owner		= THIS_MODULE,
+};
+
+static int __init rrsched_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct rrsched_priv) >
+		     MPTCP_SCHED_PRIV_SIZE * sizeof(u32));
+
+	return mptcp_register_scheduler(&mptcp_sched_rr);
+}
+
+static void __exit rrsched_unregister(void)
+{
+	mptcp_unregister_scheduler(&mptcp_sched_rr);
+}
+
+module_init(rrsched_register);
+module_exit(rrsched_unregister);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MPTCP weighted round-robin scheduler");
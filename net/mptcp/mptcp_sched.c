@@ -0,0 +1,451 @@
+/*
+ *	MPTCP implementation - Pluggable packet scheduler
+ *
+ *	Initial Design & Implementation:
+ *	Sébastien Barré <sebastien.barre@uclouvain.be>
+ *
+ *	Current Maintainer & Author:
+ *	Christoph Paasch <christoph.paasch@uclouvain.be>
+ *
+ *	Additional authors:
+ *	Jaakko Korkeaniemi <jaakko.korkeaniemi@aalto.fi>
+ *	Gregory Detal <gregory.detal@uclouvain.be>
+ *	Fabien Duchêne <fabien.duchene@uclouvain.be>
+ *	Andreas Seelinger <Andreas.Seelinger@rwth-aachen.de>
+ *	Lavkesh Lahngir <lavkesh51@gmail.com>
+ *	Andreas Ripke <ripke@neclab.eu>
+ *	Vlad Dogaru <vlad.dogaru@intel.com>
+ *	Octavian Purdila <octavian.purdila@intel.com>
+ *	John Ronan <jronan@tssg.org>
+ *	Catalin Nicutar <catalin.nicutar@gmail.com>
+ *	Brandon Heller <brandonh@stanford.edu>
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kmod.h>
+#include <linux/module.h>
+#include <linux/rculist.h>
+#include <linux/skbuff.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/tcp.h>
+
+#include <net/mptcp.h>
+#include <net/sock.h>
+
+#include <trace/events/mptcp.h>
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* If the sub-socket sk available to send the skb? */
+int mptcp_is_available(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	/* Set of states for which we are allowed to send data */
+	if (!mptcp_sk_can_send(sk))
+		return 0;
+
+	/* We do not send data on this subflow unless it is
+	 * fully established, i.e. the 4th ack has been received.
+	 */
+	if (tp->mptcp->pre_established)
+		return 0;
+
+	if (tp->pf ||
+	    (tp->mpcb->noneligible & mptcp_pi_to_flag(tp->mptcp->path_index)))
+		return 0;
+
+	if (inet_csk(sk)->icsk_ca_state == TCP_CA_Loss) {
+		/* If SACK is disabled, and we got a loss, TCP does not exist
+		 * the loss-state until something above high_seq has been acked.
+		 * (see tcp_try_undo_recovery)
+		 *
+		 * high_seq is the snd_nxt at the moment of the RTO. As soon
+		 * as we have an RTO, we won't push data on the subflow.
+		 * Thus, snd_una can never go beyond high_seq.
+		 */
+		if (!tcp_is_reno(tp))
+			return 0;
+		else if (tp->snd_una != tp->high_seq)
+			return 0;
+	}
+
+	if (!tp->mptcp->fully_established) {
+		/* Make sure that we send in-order data */
+		if (skb && tp->mptcp->second_packet &&
+		    tp->mptcp->last_end_data_seq != TCP_SKB_CB(skb)->seq)
+			return 0;
+	}
+
+	/* Don't send on this subflow if we bypass the allowed send-window at
+	 * the per-subflow level. Similar to tcp_snd_wnd_test, but manually
+	 * calculated end_seq (because here at this point end_seq is still at
+	 * the meta-level).
+	 * A segment bigger than one MSS gets split in mptcp_write_xmit, thus
+	 * the first MSS must fit.
+	 */
+	if (skb && after(tp->write_seq + min(skb->len, tp->mss_cache),
+			 tcp_wnd_end(tp)))
+		return 0;
+
+	return tcp_cwnd_test(tp, skb);
+}
+EXPORT_SYMBOL_GPL(mptcp_is_available);
+
+/* Are we not allowed to reinject this skb on tp? */
+int mptcp_dont_reinject_skb(struct tcp_sock *tp, struct sk_buff *skb)
+{
+	/* If the skb has already been enqueued in this sk, try to find
+	 * another one.
+	 * An exception is a DATA_FIN without data. These ones are not
+	 * reinjected at the subflow-level as they do not consume
+	 * subflow-sequence-number space.
+	 */
+	return skb &&
+		/* We either have a data_fin with data or not a data_fin */
+		((mptcp_is_data_fin(skb) && TCP_SKB_CB(skb)->end_seq - TCP_SKB_CB(skb)->seq  > 1) ||
+		!mptcp_is_data_fin(skb)) &&
+		/* Has the skb already been enqueued into this subsocket? */
+		mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask;
+}
+EXPORT_SYMBOL_GPL(mptcp_dont_reinject_skb);
+
+/* This is the default scheduler. This function decides on which flow to send
+ * a given MSS. If all subflows are found to be busy, NULL is returned
+ * The flow is selected based on the shortest RTT.
+ * If all paths have full cong windows, we simply return NULL.
+ *
+ * Additionally, this function is aware of the backup-subflows.
+ */
+static struct sock *__get_available_subflow(struct sock *meta_sk,
+					    struct sk_buff *skb)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sock *sk, *bestsk = NULL, *lowpriosk = NULL, *backupsk = NULL;
+	u32 min_time_to_peer = 0xffffffff, lowprio_min_time_to_peer = 0xffffffff;
+	int cnt_backups = 0;
+
+	/* if there is only one subflow, bypass the scheduling function */
+	if (mpcb->cnt_subflows == 1) {
+		bestsk = (struct sock *)mpcb->connection_list;
+		if (!mptcp_is_available(bestsk, skb))
+			bestsk = NULL;
+		return bestsk;
+	}
+
+	/* Answer data_fin on same subflow!!! */
+	if (meta_sk->sk_shutdown & RCV_SHUTDOWN &&
+	    skb && mptcp_is_data_fin(skb)) {
+		mptcp_for_each_sk(mpcb, sk) {
+			if (tcp_sk(sk)->mptcp->path_index == mpcb->dfin_path_index &&
+			    mptcp_is_available(sk, skb))
+				return sk;
+		}
+	}
+
+	/* First, find the best subflow */
+	mptcp_for_each_sk(mpcb, sk) {
+		struct tcp_sock *tp = tcp_sk(sk);
+		if (tp->mptcp->rcv_low_prio || tp->mptcp->low_prio)
+			cnt_backups++;
+
+		if (!mptcp_is_available(sk, skb))
+			continue;
+
+		if (mptcp_dont_reinject_skb(tp, skb)) {
+			backupsk = sk;
+			continue;
+		}
+
+		if ((tp->mptcp->rcv_low_prio || tp->mptcp->low_prio) &&
+		    tp->srtt < lowprio_min_time_to_peer &&
+		    !(skb && mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask)) {
+			lowprio_min_time_to_peer = tp->srtt;
+			lowpriosk = sk;
+		} else if (!(tp->mptcp->rcv_low_prio || tp->mptcp->low_prio) &&
+		    tp->srtt < min_time_to_peer &&
+		    !(skb && mptcp_pi_to_flag(tp->mptcp->path_index) & TCP_SKB_CB(skb)->path_mask)) {
+			min_time_to_peer = tp->srtt;
+			bestsk = sk;
+		}
+	}
+
+	if (mpcb->cnt_established == cnt_backups && lowpriosk)
+		return lowpriosk;
+	if (bestsk)
+		return bestsk;
+	if (backupsk) {
+		/* It has been sent on all subflows once - let's give it a
+		 * chance again by restarting its pathmask.
+		 */
+		if (skb)
+			TCP_SKB_CB(skb)->path_mask = 0;
+		return backupsk;
+	}
+	return NULL;
+}
+
+struct sock *mptcp_default_get_subflow(struct sock *meta_sk,
+				       struct sk_buff *skb)
+{
+	struct sock *sk = __get_available_subflow(meta_sk, skb);
+
+	trace_mptcp_sched_subflow(meta_sk, sk, skb);
+
+	return sk;
+}
+EXPORT_SYMBOL_GPL(mptcp_default_get_subflow);
+
+/* Returns the next segment to be sent from the mptcp meta-queue.
+ * (chooses the reinject queue if any segment is waiting in it, otherwise,
+ * chooses the normal write queue).
+ * Sets *@reinject to 1 if the returned segment comes from the
+ * reinject queue. Sets it to 0 if it is the regular send-head of the meta-sk,
+ * and sets it to -1 if it is a meta-level retransmission to optimize the
+ * receive-buffer.
+ */
+struct sk_buff *mptcp_default_next_segment(struct sock *meta_sk, int *reinject)
+{
+	struct mptcp_cb *mpcb = tcp_sk(meta_sk)->mpcb;
+	struct sk_buff *skb = NULL;
+	if (reinject)
+		*reinject = 0;
+
+	/* If we are in fallback-mode, just take from the meta-send-queue */
+	if (mpcb->infinite_mapping_snd || mpcb->send_infinite_mapping)
+		return tcp_send_head(meta_sk);
+
+	skb = skb_peek(&mpcb->reinject_queue);
+
+	if (skb) {
+		if (reinject)
+			*reinject = 1;
+	} else {
+		skb = tcp_send_head(meta_sk);
+
+		if (!skb && meta_sk->sk_write_pending &&
+		    sk_stream_wspace(meta_sk) < sk_stream_min_wspace(meta_sk)) {
+			struct sock *subsk = mptcp_get_subflow(meta_sk, NULL);
+			if (!subsk)
+				return NULL;
+
+			skb = mptcp_rcv_buf_optimization(subsk, 0);
+			if (skb && reinject)
+				*reinject = -1;
+		}
+	}
+	return skb;
+}
+EXPORT_SYMBOL_GPL(mptcp_default_next_segment);
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_default_get_subflow,
+	.next_segment	= mptcp_default_next_segment,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+/* Simple linear search, don't expect many entries! */
+static struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *e;
+
+	list_for_each_entry_rcu(e, &mptcp_sched_list, list) {
+		if (strcmp(e->name, name) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Attach a new scheduler to the list of available ones. */
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_subflow || !sched->next_segment) {
+		pr_err("MPTCP scheduler %s does not implement required ops\n",
+		       sched->name);
+		return -EINVAL;
+	}
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		pr_notice("MPTCP scheduler %s already registered\n",
+			  sched->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_info("MPTCP scheduler %s registered\n", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+/* Remove a scheduler, called from the module's remove function. Module ref
+ * counts ensure that this can't be done while a connection still uses it.
+ */
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+/* Get the name of the current default scheduler */
+void mptcp_get_default_scheduler(char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	BUG_ON(list_empty(&mptcp_sched_list));
+
+	rcu_read_lock();
+	sched = list_entry(mptcp_sched_list.next, struct mptcp_sched_ops, list);
+	strlcpy(name, sched->name, MPTCP_SCHED_NAME_MAX);
+	rcu_read_unlock();
+}
+
+/* Used by sysctl to change the default scheduler */
+int mptcp_set_default_scheduler(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+	int ret = -ENOENT;
+
+	spin_lock(&mptcp_sched_list_lock);
+	sched = mptcp_sched_find(name);
+#ifdef CONFIG_MODULES
+	if (!sched && capable(CAP_NET_ADMIN)) {
+		spin_unlock(&mptcp_sched_list_lock);
+
+		request_module("mptcp_%s", name);
+		spin_lock(&mptcp_sched_list_lock);
+		sched = mptcp_sched_find(name);
+	}
+#endif
+
+	if (sched) {
+		list_move(&sched->list, &mptcp_sched_list);
+		ret = 0;
+	} else {
+		pr_info("MPTCP scheduler %s not available\n", name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+
+/* Remember the scheduler requested by the application on this socket. The
+ * mpcb does not exist yet, thus we only store the name. It will be resolved
+ * once the connection becomes multipath-capable (mptcp_init_scheduler).
+ * If the connection is already established, we switch the scheduler of the
+ * running connection.
+ */
+int mptcp_set_scheduler(struct sock *sk, const char *name)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct mptcp_sched_ops *sched;
+	int err = 0;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+
+#ifdef CONFIG_MODULES
+	if (!sched && capable(CAP_NET_ADMIN)) {
+		rcu_read_unlock();
+		request_module("mptcp_%s", name);
+		rcu_read_lock();
+		sched = mptcp_sched_find(name);
+	}
+#endif
+	if (!sched) {
+		err = -ENOENT;
+		goto out;
+	}
+
+	if (is_meta_sk(sk) && tp->mpcb->sched_ops != sched) {
+		struct mptcp_cb *mpcb = tp->mpcb;
+		struct tcp_sock *tp_it;
+
+		if (!try_module_get(sched->owner)) {
+			err = -EBUSY;
+			goto out;
+		}
+
+		mptcp_cleanup_scheduler(mpcb);
+		mpcb->sched_ops = sched;
+
+		mptcp_for_each_tp(mpcb, tp_it)
+			memset(tp_it->mptcp->mptcp_sched, 0,
+			       sizeof(tp_it->mptcp->mptcp_sched));
+
+		if (sched->init)
+			sched->init(sk);
+	}
+
+	/* Only once the module reference is taken, as in
+	 * tcp_set_congestion_control.
+	 */
+	strlcpy(tp->mptcp_sched_name, name, MPTCP_SCHED_NAME_MAX);
+out:
+	rcu_read_unlock();
+	return err;
+}
+
+/* Assign the scheduler of a new multipath connection. Uses the one selected
+ * on the socket, or falls back to the default one.
+ */
+void mptcp_init_scheduler(struct mptcp_cb *mpcb)
+{
+	struct tcp_sock *meta_tp = tcp_sk(mpcb->meta_sk);
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	if (meta_tp->mptcp_sched_name[0]) {
+		sched = mptcp_sched_find(meta_tp->mptcp_sched_name);
+		if (sched && try_module_get(sched->owner))
+			goto found;
+	}
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (try_module_get(sched->owner))
+			goto found;
+		/* fallback to next available */
+	}
+
+	sched = &mptcp_sched_default;
+	__module_get(sched->owner);
+found:
+	mpcb->sched_ops = sched;
+	rcu_read_unlock();
+
+	if (sched->init)
+		sched->init(mpcb->meta_sk);
+}
+
+/* Manage refcounts on connection close. */
+void mptcp_cleanup_scheduler(struct mptcp_cb *mpcb)
+{
+	struct mptcp_sched_ops *sched = mpcb->sched_ops;
+
+	if (!sched)
+		return;
+
+	if (sched->release)
+		sched->release(mpcb->meta_sk);
+	module_put(sched->owner);
+	mpcb->sched_ops = NULL;
+}
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+}
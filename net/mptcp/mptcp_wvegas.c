@@ -0,0 +1,297 @@
+/*
+ *	MPTCP implementation - WEIGHTED VEGAS
+ *
+ *	Algorithm design (weighted Vegas):
+ *	Yu Cao, Mingwei Xu, Xiaoming Fu
+ *
+ *	Delay-based coupled congestion control. Each subflow keeps alpha packets
+ *	queued in the network, like Vegas. The total of all alphas is fixed
+ *	(total_alpha), and split among the subflows in proportion to their
+ *	rate. A subflow whose path is more congested thus gets a lower rate
+ *	and a smaller share of the total alpha, which shifts the load towards
+ *	the less congested paths while keeping the queues short.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <net/tcp.h>
+#include <net/mptcp.h>
+
+#include <linux/module.h>
+
+static int initial_alpha = 2;
+static int total_alpha = 10;
+static int gamma = 1;
+
+module_param(initial_alpha, int, 0644);
+MODULE_PARM_DESC(initial_alpha, "initial alpha for all subflows");
+module_param(total_alpha, int, 0644);
+MODULE_PARM_DESC(total_alpha, "total alpha for all subflows");
+module_param(gamma, int, 0644);
+MODULE_PARM_DESC(gamma, "limit on increase (scale by 2)");
+
+/* Scaling of the rates and weights */
+static int scale = 16;
+
+struct mptcp_wvegas {
+	u32	beg_snd_nxt;	/* right edge during last RTT */
+	u8	doing_wvegas_now;
+
+	u16	cnt_rtt;	/* # of RTTs measured within last RTT */
+	u32	min_rtt;	/* min of RTTs measured within last RTT (usec) */
+	u32	base_rtt;	/* the min of all wVegas RTT measurements seen (usec) */
+
+	u64	instant_rate;	/* cwnd / srtt_us, scaled by scale */
+	u64	weight;		/* share of the subflow's rate, scaled by scale */
+	int	alpha;		/* alpha of this subflow */
+
+	u32	queue_delay;	/* smallest queuing delay seen since the last drain */
+};
+
+static inline int mptcp_wvegas_sk_can_send(const struct sock *sk)
+{
+	return mptcp_sk_can_send(sk) && tcp_sk(sk)->srtt;
+}
+
+static inline u64 mptcp_wvegas_scale(u32 val, int scale)
+{
+	return (u64) val << scale;
+}
+
+static void wvegas_enable(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+
+	wvegas->doing_wvegas_now = 1;
+
+	wvegas->beg_snd_nxt = tp->snd_nxt;
+
+	wvegas->cnt_rtt = 0;
+	wvegas->min_rtt = 0x7fffffff;
+
+	wvegas->instant_rate = 0;
+	wvegas->alpha = initial_alpha;
+	wvegas->weight = mptcp_wvegas_scale(1, scale);
+
+	wvegas->queue_delay = 0;
+}
+
+static inline void wvegas_disable(struct sock *sk)
+{
+	struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+
+	wvegas->doing_wvegas_now = 0;
+}
+
+static void mptcp_wvegas_init(struct sock *sk)
+{
+	struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+
+	wvegas->base_rtt = 0x7fffffff;
+	wvegas_enable(sk);
+}
+
+static void mptcp_wvegas_pkts_acked(struct sock *sk, u32 cnt, s32 rtt_us)
+{
+	struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+	u32 vrtt;
+
+	if (rtt_us < 0)
+		return;
+
+	/* Never allow zero rtt or base_rtt */
+	vrtt = rtt_us + 1;
+
+	if (vrtt < wvegas->base_rtt)
+		wvegas->base_rtt = vrtt;
+
+	/* Find the min RTT during the last RTT to find
+	 * the current prop. delay + queuing delay.
+	 */
+	wvegas->min_rtt = min(wvegas->min_rtt, vrtt);
+	wvegas->cnt_rtt++;
+}
+
+static void mptcp_wvegas_state(struct sock *sk, u8 ca_state)
+{
+	if (ca_state == TCP_CA_Open)
+		wvegas_enable(sk);
+	else
+		wvegas_disable(sk);
+}
+
+static void mptcp_wvegas_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	if (event == CA_EVENT_CWND_RESTART) {
+		mptcp_wvegas_init(sk);
+	} else if (event == CA_EVENT_LOSS) {
+		struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+
+		wvegas->instant_rate = 0;
+	}
+}
+
+static inline u32 mptcp_wvegas_ssthresh(const struct tcp_sock *tp)
+{
+	return min(tp->snd_ssthresh, tp->snd_cwnd - 1);
+}
+
+/* The share of this subflow in the total rate of the connection */
+static u64 mptcp_wvegas_weight(const struct mptcp_cb *mpcb,
+			       const struct sock *sk)
+{
+	const struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+	struct sock *sub_sk;
+	u64 total_rate = 0;
+
+	mptcp_for_each_sk(mpcb, sub_sk) {
+		const struct mptcp_wvegas *sub_wvegas = inet_csk_ca(sub_sk);
+
+		if (!mptcp_wvegas_sk_can_send(sub_sk))
+			continue;
+
+		total_rate += sub_wvegas->instant_rate;
+	}
+
+	if (!total_rate || wvegas->instant_rate >= total_rate)
+		return mptcp_wvegas_scale(1, scale);
+
+	return div64_u64(wvegas->instant_rate << scale, total_rate);
+}
+
+static void mptcp_wvegas_cong_avoid(struct sock *sk, u32 ack, u32 in_flight)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct mptcp_wvegas *wvegas = inet_csk_ca(sk);
+
+	if (!wvegas->doing_wvegas_now || !tp->mpc) {
+		tcp_reno_cong_avoid(sk, ack, in_flight);
+		return;
+	}
+
+	if (after(ack, wvegas->beg_snd_nxt)) {
+		/* Do the wVegas once-per-RTT cwnd adjustment. */
+		wvegas->beg_snd_nxt = tp->snd_nxt;
+
+		if (wvegas->cnt_rtt <= 2) {
+			/* We don't have enough RTT samples to do the wVegas
+			 * calculation, so we'll behave like Reno.
+			 */
+			tcp_reno_cong_avoid(sk, ack, in_flight);
+		} else {
+			u32 rtt, diff, q_delay;
+			u64 target_cwnd;
+
+			/* We use the min RTT of the last RTT, to filter
+			 * the effects of delayed ACKs.
+			 */
+			rtt = wvegas->min_rtt;
+			target_cwnd = div_u64((u64)tp->snd_cwnd *
+					      wvegas->base_rtt, rtt);
+
+			/* The number of packets queued in the network */
+			diff = div_u64((u64)tp->snd_cwnd *
+				       (rtt - wvegas->base_rtt), rtt);
+
+			if (diff > gamma && tp->snd_cwnd <= tp->snd_ssthresh) {
+				/* Going too fast. Time to slow down
+				 * and switch to congestion avoidance.
+				 */
+				tp->snd_cwnd = min(tp->snd_cwnd,
+						   (u32)target_cwnd + 1);
+				tp->snd_ssthresh = mptcp_wvegas_ssthresh(tp);
+			} else if (tp->snd_cwnd <= tp->snd_ssthresh) {
+				/* Slow start. */
+				tcp_slow_start(tp);
+			} else {
+				/* Congestion avoidance. Split the total alpha
+				 * according to the rates of the subflows.
+				 */
+				wvegas->instant_rate =
+					div_u64(mptcp_wvegas_scale(tp->snd_cwnd,
+								   scale),
+						rtt);
+				wvegas->weight = mptcp_wvegas_weight(tp->mpcb,
+								     sk);
+				wvegas->alpha = max_t(int, 2,
+					(wvegas->weight * total_alpha) >> scale);
+
+				if (diff > wvegas->alpha) {
+					tp->snd_cwnd--;
+					tp->snd_ssthresh = mptcp_wvegas_ssthresh(tp);
+				} else if (diff < wvegas->alpha) {
+					tp->snd_cwnd++;
+				}
+
+				/* If the queuing delay doubled since the
+				 * smallest one we have seen, drain the queue.
+				 */
+				q_delay = rtt - wvegas->base_rtt;
+				if (!wvegas->queue_delay ||
+				    wvegas->queue_delay > q_delay)
+					wvegas->queue_delay = q_delay;
+
+				if (q_delay && q_delay >= 2 * wvegas->queue_delay) {
+					u32 backoff = div_u64(
+						mptcp_wvegas_scale(wvegas->base_rtt,
+								   scale),
+						2 * rtt);
+
+					tp->snd_cwnd = ((u64)tp->snd_cwnd *
+							backoff) >> scale;
+					wvegas->queue_delay = 0;
+				}
+			}
+
+			if (tp->snd_cwnd < 2)
+				tp->snd_cwnd = 2;
+			else if (tp->snd_cwnd > tp->snd_cwnd_clamp)
+				tp->snd_cwnd = tp->snd_cwnd_clamp;
+
+			tp->snd_ssthresh = tcp_current_ssthresh(sk);
+		}
+
+		wvegas->cnt_rtt = 0;
+		wvegas->min_rtt = 0x7fffffff;
+	} else if (tp->snd_cwnd <= tp->snd_ssthresh) {
+		/* Use normal slow start */
+		if (tcp_is_cwnd_limited(sk, in_flight))
+			tcp_slow_start(tp);
+	}
+}
+
+static struct tcp_congestion_ops mptcp_wvegas = {
+	.flags		= TCP_CONG_RTT_STAMP,
+	.init		= mptcp_wvegas_init,
+	.ssthresh	= tcp_reno_ssthresh,
+	.cong_avoid	= mptcp_wvegas_cong_avoid,
+	.min_cwnd	= tcp_reno_min_cwnd,
+	.pkts_acked	= mptcp_wvegas_pkts_acked,
+	.set_state	= mptcp_wvegas_state,
+	.cwnd_event	= mptcp_wvegas_cwnd_event,
+
+	.owner		= THIS_MODULE,
+	.name		= "wvegas",
+};
+
+static int __init mptcp_wvegas_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct mptcp_wvegas) > ICSK_CA_PRIV_SIZE);
+	return tcp_register_congestion_control(&mptcp_wvegas);
+}
+
+static void __exit mptcp_wvegas_unregister(void)
+{
+	tcp_unregister_congestion_control(&mptcp_wvegas);
+}
+
+module_init(mptcp_wvegas_register);
+module_exit(mptcp_wvegas_unregister);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MPTCP wVegas");
+MODULE_VERSION("0.1");